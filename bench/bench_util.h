@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cctype>
+#include <cstdlib>
+#include <vector>
+
+// parses a comma separated list of positive numbers like "16,256,4096". Returns an empty
+// list if an entry is 0 or not a number, so the caller can print its usage instead.
+inline std::vector<size_t> parseList(const char* text) {
+    std::vector<size_t> values;
+    for (auto start = text;;) {
+        if (!std::isdigit(static_cast<unsigned char>(*start))) {
+            return {};
+        }
+        char* end;
+        auto value = std::strtoull(start, &end, 10);
+        if (value == 0 || (*end != ',' && *end != '\0')) {
+            return {};
+        }
+        values.push_back(value);
+        if (*end == '\0') {
+            return values;
+        }
+        start = end + 1;
+    }
+}
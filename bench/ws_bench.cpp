@@ -0,0 +1,419 @@
+/** Micro-benchmarks of the message hot paths, without sclang.
+
+Build with `-DSC_WEBSOCKET_BENCH=ON` and run
+
+    ws_bench [--port 21000] [--sizes 16,256,4096,65536,1048576] [--threads 1,2,4] [--unix /tmp/ws_bench.sock]
+
+- `view` and `payload` measure creating a view of a received message
+  and copying a message into a payload, which happens for every send
+- `send` measures pipelined sends from enqueueing until the message was read by the peer.
+  All messages get enqueued at once, so once the submission ring is full the sender waits for the strand.
+  Its allocations are the memory of the backlog, which outgrows the buffer pool
+- `ring` sends the same messages in bursts which fit into the submission ring, so it only measures the ring
+- `echo` measures round trips through a session which sends every message back
+
+Every thread count runs as many io threads as connections, all over loopback,
+or over a unix domain socket at the given path if `--unix` is set.
+Allocations get counted through the global operator new and are reported per message.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+
+#include "bench_util.h"
+#include "ws_client.h"
+#include "ws_common.h"
+#include "ws_server.h"
+
+namespace {
+std::atomic<uint64_t> gNumAllocations = 0;
+}
+
+void* operator new(size_t size) {
+    gNumAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    int port = 21000;
+    // connect via a unix domain socket at this path instead of TCP
+    std::string localPath;
+    std::vector<size_t> sizes = { 16, 256, 4096, 65536, 1048576 };
+    std::vector<size_t> threads = { 1, 2, 4 };
+};
+
+struct Result {
+    double seconds = 0.0;
+    size_t numMessages = 0;
+    size_t messageSize = 0;
+    uint64_t numAllocations = 0;
+    // round trip times in microseconds, only for echo
+    std::vector<double> latencies;
+};
+
+// keeps the runs of large messages short, while small messages get enough samples
+size_t numMessagesFor(size_t size, size_t maxMessages) {
+    return std::clamp<size_t>((64 * 1024 * 1024) / size, 200, maxMessages);
+}
+
+double percentile(std::vector<double>& sorted, double quantile) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(quantile * sorted.size()))];
+}
+
+void report(const char* name, bool isText, size_t numThreads, Result& result) {
+    auto messagesPerSecond = result.numMessages / result.seconds;
+    std::printf(
+        "%-8s %-6s size=%8zu threads=%zu  msgs/s=%11.0f  MB/s=%9.1f  allocs/msg=%6.2f",
+        name,
+        isText ? "text" : "binary",
+        result.messageSize,
+        numThreads,
+        messagesPerSecond,
+        messagesPerSecond * result.messageSize / 1e6,
+        static_cast<double>(result.numAllocations) / result.numMessages
+    );
+    if (!result.latencies.empty()) {
+        std::sort(result.latencies.begin(), result.latencies.end());
+        std::printf(
+            "  p50=%8.1fus p99=%8.1fus p999=%8.1fus",
+            percentile(result.latencies, 0.5),
+            percentile(result.latencies, 0.99),
+            percentile(result.latencies, 0.999)
+        );
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+}
+
+void benchView(size_t size, bool isText) {
+    boost::beast::flat_buffer buffer;
+    auto destination = buffer.prepare(size);
+    std::memset(destination.data(), 'a', size);
+    buffer.commit(size);
+
+    constexpr size_t kIterations = 1000000;
+    size_t checksum = 0;
+    auto allocationsBefore = gNumAllocations.load();
+    auto start = Clock::now();
+    for (size_t i = 0; i < kIterations; i++) {
+        auto view = viewData(buffer, size, isText);
+        checksum += view.data[i % view.size];
+    }
+    Result result;
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.numAllocations = gNumAllocations.load() - allocationsBefore;
+    result.numMessages = kIterations;
+    result.messageSize = size;
+    report("view", isText, 1, result);
+    if (checksum == 0) {
+        std::printf("unexpected checksum\n");
+    }
+}
+
+void benchPayload(size_t size, bool isText) {
+    std::vector<uint8_t> data(size, 'a');
+    auto numIterations = numMessagesFor(size, 1000000);
+    size_t checksum = 0;
+    // warm up the buffer pool
+    WebSocketPayload::copyFrom(data.data(), size, isText);
+
+    auto allocationsBefore = gNumAllocations.load();
+    auto start = Clock::now();
+    for (size_t i = 0; i < numIterations; i++) {
+        auto payload = WebSocketPayload::copyFrom(data.data(), size, isText);
+        checksum += payload.buffer().size();
+    }
+    Result result;
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.numAllocations = gNumAllocations.load() - allocationsBefore;
+    result.numMessages = numIterations;
+    result.messageSize = size;
+    report("payload", isText, 1, result);
+    if (checksum != numIterations * size) {
+        std::printf("unexpected checksum\n");
+    }
+}
+
+// signals the benchmark thread once a number of events has happened on the io threads
+class Countdown {
+public:
+    void reset(size_t count) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mCount = count;
+    }
+
+    void arrive() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mCount > 0 && --mCount == 0) {
+            mCondition.notify_all();
+        }
+    }
+
+    // returns false on timeout
+    bool wait(std::chrono::seconds timeout) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        return mCondition.wait_for(lock, timeout, [this]() { return mCount == 0; });
+    }
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    size_t mCount = 0;
+};
+
+/** A loopback setup of a listener and a number of clients running on their own io threads.
+Sessions either send every received message back or only count them.
+*/
+class Loopback {
+public:
+    // a client and what it does with the messages it receives - only accessed from its strand
+    struct Connection {
+        std::shared_ptr<WebSocketClient> client;
+        WebSocketPayload message;
+        size_t numRemaining = 0;
+        Clock::time_point sentAt;
+        std::vector<double> latencies;
+    };
+
+    Loopback(std::string host, int port, size_t numThreads) {
+        beast::error_code ec;
+        mListener = std::make_shared<WebSocketListener>(mContext, host, port, ec);
+        if (ec) {
+            std::fprintf(stderr, "could not listen on %s:%d: %s\n", host.c_str(), port, ec.message().c_str());
+            std::exit(1);
+        }
+        mListener->setNewSessionCallback([this](std::shared_ptr<WebSocketSession> session) {
+            // the session has not been started yet, so its callbacks can be set directly.
+            // the callback is a member of the session, so it can not outlive it
+            auto rawSession = session.get();
+            session->mMessageReceivedCallback = [this, rawSession](const WebSocketDataView* messages, size_t num) {
+                for (size_t i = 0; i < num; i++) {
+                    if (mEcho) {
+                        rawSession->enqueueMessage(
+                            WebSocketPayload::copyFrom(messages[i].data, messages[i].size, messages[i].isText)
+                        );
+                    } else {
+                        mReceived.arrive();
+                    }
+                }
+            };
+        });
+        mListener->run();
+
+        for (size_t i = 0; i < numThreads; i++) {
+            mThreads.emplace_back([this]() { mContext.run(); });
+        }
+
+        mConnected.reset(numThreads);
+        mConnections.resize(numThreads);
+        for (auto& connection : mConnections) {
+            connection.client = std::make_shared<WebSocketClient>(mContext, host, port);
+            connection.client->mSclangConnectionChangeCallback = [this](bool connected, uint32_t, bool) {
+                if (connected) {
+                    mConnected.arrive();
+                }
+            };
+            connection.client->mSclangOnMessageCallback = [this, &connection](const WebSocketDataView*, size_t num) {
+                for (size_t i = 0; i < num; i++) {
+                    onEcho(connection);
+                }
+            };
+            connection.client->connect();
+        }
+        if (!mConnected.wait(std::chrono::seconds(10))) {
+            std::fprintf(stderr, "could not connect to %s:%d\n", host.c_str(), port);
+            std::exit(1);
+        }
+    }
+
+    ~Loopback() {
+        for (auto& connection : mConnections) {
+            connection.client->closeConnection();
+        }
+        mListener->stop();
+        // let the closing handshakes complete
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        mContext.stop();
+        for (auto& thread : mThreads) {
+            thread.join();
+        }
+    }
+
+    // every connection sends its messages as fast as possible, in bursts of at most burstSize messages
+    Result send(size_t size, bool isText, size_t numMessagesPerConnection, size_t burstSize = SIZE_MAX) {
+        mEcho = false;
+        std::vector<uint8_t> data(size, 'a');
+        // warm up the buffer pool and the handler memory
+        run(data, isText, std::min<size_t>(numMessagesPerConnection / 10 + 1, 100), burstSize);
+
+        auto allocationsBefore = gNumAllocations.load();
+        auto start = Clock::now();
+        auto numMessages = run(data, isText, numMessagesPerConnection, burstSize);
+        Result result;
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        result.numAllocations = gNumAllocations.load() - allocationsBefore;
+        result.numMessages = numMessages;
+        result.messageSize = size;
+        return result;
+    }
+
+    // every connection sends its next message once the previous one came back
+    Result echo(size_t size, bool isText, size_t numRoundTripsPerConnection) {
+        mEcho = true;
+        std::vector<uint8_t> data(size, 'a');
+        startEcho(data, isText, std::min<size_t>(numRoundTripsPerConnection / 10 + 1, 100));
+
+        auto allocationsBefore = gNumAllocations.load();
+        auto start = Clock::now();
+        startEcho(data, isText, numRoundTripsPerConnection);
+        Result result;
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        result.numAllocations = gNumAllocations.load() - allocationsBefore;
+        result.numMessages = numRoundTripsPerConnection * mConnections.size();
+        result.messageSize = size;
+        for (auto& connection : mConnections) {
+            result.latencies.insert(result.latencies.end(), connection.latencies.begin(), connection.latencies.end());
+        }
+        return result;
+    }
+
+private:
+    // the next burst gets sent once all messages of the previous one have been received
+    size_t run(const std::vector<uint8_t>& data, bool isText, size_t numMessagesPerConnection, size_t burstSize) {
+        size_t numMessages = 0;
+        for (size_t numSent = 0; numSent < numMessagesPerConnection;) {
+            auto numBurst = std::min(burstSize, numMessagesPerConnection - numSent);
+            mReceived.reset(numBurst * mConnections.size());
+            for (auto& connection : mConnections) {
+                for (size_t i = 0; i < numBurst; i++) {
+                    connection.client->enqueueMessage(WebSocketPayload::copyFrom(data.data(), data.size(), isText));
+                }
+            }
+            waitFor(mReceived);
+            numSent += numBurst;
+            numMessages += numBurst * mConnections.size();
+        }
+        return numMessages;
+    }
+
+    void startEcho(const std::vector<uint8_t>& data, bool isText, size_t numRoundTripsPerConnection) {
+        mReceived.reset(mConnections.size());
+        for (auto& connection : mConnections) {
+            connection.client->runOnStrand([&connection, &data, isText, numRoundTripsPerConnection]() {
+                connection.message = WebSocketPayload::copyFrom(data.data(), data.size(), isText);
+                connection.numRemaining = numRoundTripsPerConnection;
+                connection.latencies.clear();
+                connection.latencies.reserve(numRoundTripsPerConnection);
+                connection.sentAt = Clock::now();
+                connection.client->enqueueMessage(connection.message.share());
+            });
+        }
+        waitFor(mReceived);
+    }
+
+    // gets called from the strand of the client
+    void onEcho(Connection& connection) {
+        auto now = Clock::now();
+        connection.latencies.push_back(std::chrono::duration<double, std::micro>(now - connection.sentAt).count());
+        if (--connection.numRemaining == 0) {
+            mReceived.arrive();
+            return;
+        }
+        connection.sentAt = now;
+        connection.client->enqueueMessage(connection.message.share());
+    }
+
+    void waitFor(Countdown& countdown) {
+        if (!countdown.wait(std::chrono::seconds(120))) {
+            std::fprintf(stderr, "benchmark timed out\n");
+            std::exit(1);
+        }
+    }
+
+    boost::asio::io_context mContext;
+    std::shared_ptr<WebSocketListener> mListener;
+    std::vector<std::thread> mThreads;
+    std::vector<Connection> mConnections;
+    std::atomic<bool> mEcho = false;
+    Countdown mConnected;
+    Countdown mReceived;
+};
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    auto isValid = true;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string name = argv[i];
+        if (name == "--port") {
+            options.port = std::atoi(argv[i + 1]);
+        } else if (name == "--sizes") {
+            options.sizes = parseList(argv[i + 1]);
+        } else if (name == "--threads") {
+            options.threads = parseList(argv[i + 1]);
+        } else if (name == "--unix") {
+            options.localPath = argv[i + 1];
+        } else {
+            isValid = false;
+        }
+    }
+    // a size or thread count of 0 would divide by zero when splitting up the messages
+    if (!isValid || options.sizes.empty() || options.threads.empty()) {
+        std::fprintf(stderr, "usage: ws_bench [--port N] [--sizes 16,256,...] [--threads 1,2,...] [--unix PATH]\n");
+        return 1;
+    }
+
+    for (auto isText : { false, true }) {
+        for (auto size : options.sizes) {
+            benchView(size, isText);
+            benchPayload(size, isText);
+        }
+    }
+
+    // every loopback gets its own port, so a socket of a previous run in TIME_WAIT does not interfere
+    auto port = options.port;
+    auto host = options.localPath.empty() ? std::string("127.0.0.1") : "unix:" + options.localPath;
+    for (auto numThreads : options.threads) {
+        Loopback loopback(host, port++, numThreads);
+        for (auto isText : { false, true }) {
+            for (auto size : options.sizes) {
+                auto sendResult = loopback.send(size, isText, numMessagesFor(size, 100000) / numThreads);
+                report("send", isText, numThreads, sendResult);
+                // a quarter of the submission ring, so a burst never fills it
+                auto ringResult = loopback.send(size, isText, numMessagesFor(size, 100000) / numThreads, 256);
+                report("ring", isText, numThreads, ringResult);
+                auto echoResult = loopback.echo(size, isText, numMessagesFor(size, 20000) / numThreads);
+                report("echo", isText, numThreads, echoResult);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,547 @@
+/** A mock gluon host which loads the plugin like sclang does, without SuperCollider.
+
+Build with `-DSC_WEBSOCKET_GLUON_HOST=ON` and run
+
+    ws_gluon_host [--library path/to/sclang_websocket.gluon] [--port 21100] [--sizes 16,4096,65536]
+                  [--round-trips 2000] [--load-cycles 20]
+
+The host measures
+- `load` and `unload`: the time of `sc_gluon_load_library` and `sc_gluon_unload_library`
+- `echo`: round trips from `clientSendMessage` through a session, whose message callback
+  sends the message back via `sessionSendMessage`, until the client callback ran
+- `callback`: the time from `doCallback` on an io thread until the callback ran on the language thread
+- the duration of the ffi calls themselves
+
+Afterwards it checks that deeply nested OSC bundles get rejected instead of overflowing the stack.
+
+Like sclang, the host copies the params within `doCallback` and runs all callbacks on a
+single language thread, which is also the only thread calling into the library.
+It exits with 1 if a call fails, the echo times out or a callback object does not get
+released exactly once, so it can also be used as a regression test of the ffi path.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <dlfcn.h>
+
+#include "bench_util.h"
+#include "sc_gluon_v1_types.h"
+#include "ws_osc.h"
+
+#ifndef SC_WEBSOCKET_LIBRARY_PATH
+#    define SC_WEBSOCKET_LIBRARY_PATH "sclang_websocket.gluon"
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+using VersionFunction = uint32_t (*)();
+using LoadLibraryFunction = sc_gluon_library_data_v1_t (*)(
+    sc_gluon_do_callback_v1_f,
+    sc_gluon_release_callback_object_v1_f,
+    sc_gluon_function_declarations_v1_t** const,
+    uint32_t*
+);
+using UnloadLibraryFunction = void (*)(sc_gluon_library_data_v1_t);
+
+struct Options {
+    std::string library = SC_WEBSOCKET_LIBRARY_PATH;
+    int port = 21100;
+    std::vector<size_t> sizes = { 16, 4096, 65536 };
+    size_t numRoundTrips = 2000;
+    size_t numLoadCycles = 20;
+};
+
+[[noreturn]] void fail(const std::string& message) {
+    std::fprintf(stderr, "error: %s\n", message.c_str());
+    std::exit(1);
+}
+
+double microseconds(Clock::duration duration) { return std::chrono::duration<double, std::micro>(duration).count(); }
+
+void reportLatencies(const char* name, std::vector<double>& latencies) {
+    if (latencies.empty()) {
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double quantile) {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(quantile * latencies.size()))];
+    };
+    std::printf(
+        "%-34s n=%7zu  p50=%9.1fus p99=%9.1fus p999=%9.1fus max=%9.1fus\n",
+        name,
+        latencies.size(),
+        percentile(0.5),
+        percentile(0.99),
+        percentile(0.999),
+        latencies.back()
+    );
+    std::fflush(stdout);
+}
+
+// a callable object which gets passed into the library in place of an sclang function
+struct HostCallback {
+    std::function<void(const sc_gluon_param_v1_t* params, uint32_t numParams)> function;
+};
+
+// a callback invocation including a copy of its params, waiting for the language thread
+struct CallbackEvent {
+    HostCallback* callback;
+    Clock::time_point deliveredAt;
+    std::vector<sc_gluon_param_v1_t> params;
+    std::vector<std::vector<uint8_t>> arrays;
+};
+
+/** Runs callbacks on the thread which calls `runUntil`, like the sclang interpreter does. */
+class Language {
+public:
+    void push(CallbackEvent event) {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mEvents.push_back(std::move(event));
+        }
+        mCondition.notify_one();
+    }
+
+    // runs callbacks until the condition is met, returns false on timeout
+    bool runUntil(const std::function<bool()>& condition, std::chrono::seconds timeout) {
+        auto deadline = Clock::now() + timeout;
+        while (!condition()) {
+            CallbackEvent event;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                if (!mCondition.wait_until(lock, deadline, [this]() { return !mEvents.empty(); })) {
+                    return false;
+                }
+                event = std::move(mEvents.front());
+                mEvents.pop_front();
+            }
+            callbackLatencies.push_back(microseconds(Clock::now() - event.deliveredAt));
+            if (event.callback->function) {
+                event.callback->function(event.params.data(), static_cast<uint32_t>(event.params.size()));
+            }
+        }
+        return true;
+    }
+
+    // drops the callbacks which have not been run yet
+    void clear() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mEvents.clear();
+    }
+
+    std::vector<double> callbackLatencies;
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::deque<CallbackEvent> mEvents;
+};
+
+Language gLanguage;
+std::atomic<uint64_t> gNumReleasedCallbacks = 0;
+
+void doCallback(sc_gluon_callable_object_v1_t object, sc_gluon_param_v1_t* params, uint32_t numParams) {
+    CallbackEvent event;
+    event.deliveredAt = Clock::now();
+    event.callback = static_cast<HostCallback*>(object);
+    // the params are only valid during this call
+    event.arrays.reserve(numParams);
+    for (uint32_t i = 0; i < numParams; i++) {
+        auto param = params[i];
+        if (param.tag == sc_gluon_char_array || param.tag == sc_gluon_u8_array) {
+            auto data = param.tag == sc_gluon_char_array ? reinterpret_cast<uint8_t*>(param.data.character_array)
+                                                         : param.data.u8_array;
+            auto& array = event.arrays.emplace_back(data, data + param.size);
+            if (param.tag == sc_gluon_char_array) {
+                param.data.character_array = reinterpret_cast<char*>(array.data());
+            } else {
+                param.data.u8_array = array.data();
+            }
+            param.owns_data = false;
+        }
+        event.params.push_back(param);
+    }
+    gLanguage.push(std::move(event));
+}
+
+void releaseCallback(sc_gluon_callable_object_v1_t) { gNumReleasedCallbacks++; }
+
+sc_gluon_param_v1_t intParam(int32_t value) {
+    return sc_gluon_param_v1_t{ .data = { .i32 = value }, .size = 1, .tag = sc_gluon_i32, .owns_data = false };
+}
+
+sc_gluon_param_v1_t boolParam(bool value) {
+    return sc_gluon_param_v1_t{ .data = { .boolean = value }, .size = 1, .tag = sc_gluon_bool, .owns_data = false };
+}
+
+sc_gluon_param_v1_t stringParam(const std::string& value) {
+    return sc_gluon_param_v1_t{
+        .data = { .character_array = const_cast<char*>(value.data()) },
+        .size = static_cast<uint32_t>(value.size()),
+        .tag = sc_gluon_char_array,
+        .owns_data = false,
+    };
+}
+
+sc_gluon_param_v1_t bytesParam(std::vector<uint8_t>& value, bool isText) {
+    if (isText) {
+        return sc_gluon_param_v1_t{
+            .data = { .character_array = reinterpret_cast<char*>(value.data()) },
+            .size = static_cast<uint32_t>(value.size()),
+            .tag = sc_gluon_char_array,
+            .owns_data = false,
+        };
+    }
+    return sc_gluon_param_v1_t{
+        .data = { .u8_array = value.data() },
+        .size = static_cast<uint32_t>(value.size()),
+        .tag = sc_gluon_u8_array,
+        .owns_data = false,
+    };
+}
+
+/** The plugin loaded via `dlopen`, its declared functions get called by name. */
+class GluonLibrary {
+public:
+    explicit GluonLibrary(const std::string& path) {
+        mHandle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (mHandle == nullptr) {
+            fail(std::string("could not open library: ") + dlerror());
+        }
+        auto version = reinterpret_cast<VersionFunction>(symbol("sc_gluon_version"));
+        if (version() != 1) {
+            fail("unsupported gluon version " + std::to_string(version()));
+        }
+        mLoadLibrary = reinterpret_cast<LoadLibraryFunction>(symbol("sc_gluon_load_library"));
+        mUnloadLibrary = reinterpret_cast<UnloadLibraryFunction>(symbol("sc_gluon_unload_library"));
+    }
+
+    ~GluonLibrary() {
+        if (mLibraryData) {
+            unload();
+        }
+        dlclose(mHandle);
+    }
+
+    // returns the duration of `sc_gluon_load_library`
+    Clock::duration load() {
+        sc_gluon_function_declarations_v1_t* declarations = nullptr;
+        uint32_t numDeclarations = 0;
+        auto start = Clock::now();
+        mLibraryData = mLoadLibrary(doCallback, releaseCallback, &declarations, &numDeclarations);
+        auto duration = Clock::now() - start;
+
+        mDeclarations.clear();
+        for (uint32_t i = 0; i < numDeclarations; i++) {
+            if (!mDeclarations.emplace(declarations[i].name, declarations[i]).second) {
+                fail(std::string("function declared twice: ") + declarations[i].name);
+            }
+        }
+        return duration;
+    }
+
+    // returns the duration of `sc_gluon_unload_library`
+    Clock::duration unload() {
+        auto start = Clock::now();
+        mUnloadLibrary(mLibraryData);
+        mLibraryData = nullptr;
+        return Clock::now() - start;
+    }
+
+    size_t numDeclarations() const { return mDeclarations.size(); }
+
+    // calls a declared function and fails if the library reports an error
+    sc_gluon_param_v1_t call(const std::string& name, std::vector<sc_gluon_param_v1_t> params,
+                             HostCallback* callback = nullptr) {
+        auto declaration = mDeclarations.find(name);
+        if (declaration == mDeclarations.end()) {
+            fail("function is not declared: " + name);
+        }
+        if (declaration->second.num_parms != params.size()) {
+            fail("wrong number of params for " + name);
+        }
+        if (callback) {
+            if (!declaration->second.accepts_callback) {
+                fail(name + " does not accept a callback");
+            }
+            mNumPassedCallbacks++;
+        }
+
+        sc_gluon_out_param_or_maybe_diagnostic_v1 out {};
+        auto start = Clock::now();
+        auto tag = declaration->second.ptr(
+            mLibraryData, callback, params.data(), static_cast<uint32_t>(params.size()), &out
+        );
+        auto& stats = mCallStats[name];
+        stats.numCalls++;
+        stats.duration += Clock::now() - start;
+
+        if (tag == sc_gluon_error_with_non_owned_diagnostic) {
+            fail(name + " failed: " + (out.maybe_diagnostic ? out.maybe_diagnostic : "no diagnostic"));
+        }
+        return tag == sc_gluon_produced_param ? out.out_param : sc_gluon_param_v1_t {};
+    }
+
+    uint64_t numPassedCallbacks() const { return mNumPassedCallbacks; }
+
+    void reportCallDurations() const {
+        for (const auto& [name, stats] : mCallStats) {
+            std::printf(
+                "call %-29s n=%7zu  mean=%9.2fus\n",
+                name.c_str(),
+                stats.numCalls,
+                microseconds(stats.duration) / stats.numCalls
+            );
+        }
+    }
+
+private:
+    struct CallStats {
+        size_t numCalls = 0;
+        Clock::duration duration {};
+    };
+
+    void* symbol(const char* name) {
+        auto address = dlsym(mHandle, name);
+        if (address == nullptr) {
+            fail(std::string("missing symbol ") + name);
+        }
+        return address;
+    }
+
+    void* mHandle = nullptr;
+    LoadLibraryFunction mLoadLibrary = nullptr;
+    UnloadLibraryFunction mUnloadLibrary = nullptr;
+    sc_gluon_library_data_v1_t mLibraryData = nullptr;
+    std::unordered_map<std::string, sc_gluon_function_declarations_v1_t> mDeclarations;
+    std::map<std::string, CallStats> mCallStats;
+    uint64_t mNumPassedCallbacks = 0;
+};
+
+void benchLoad(GluonLibrary& library, size_t numCycles) {
+    std::vector<double> loadDurations;
+    std::vector<double> unloadDurations;
+    for (size_t i = 0; i < numCycles; i++) {
+        loadDurations.push_back(microseconds(library.load()));
+        unloadDurations.push_back(microseconds(library.unload()));
+    }
+    reportLatencies("load", loadDurations);
+    reportLatencies("unload", unloadDurations);
+}
+
+// a listener and a client connected to it, which echo messages through sclang-like callbacks
+void benchEcho(GluonLibrary& library, const Options& options) {
+    // callback objects have to outlive the library state, which releases them
+    std::deque<HostCallback> callbacks;
+    auto makeCallback = [&callbacks](std::function<void(const sc_gluon_param_v1_t*, uint32_t)> function) {
+        return &callbacks.emplace_back(HostCallback { std::move(function) });
+    };
+
+    library.load();
+    std::string host = "127.0.0.1";
+    auto listener = library.call("listenerInit", { stringParam(host), intParam(options.port) }).data.i32;
+
+    int32_t session = -1;
+    // every message is followed by its receive age
+    auto echoCallback = makeCallback([&](const sc_gluon_param_v1_t* params, uint32_t numParams) {
+        for (uint32_t i = 0; i < numParams; i += 2) {
+            auto param = params[i];
+            library.call("sessionSendMessage", { intParam(session), boolParam(param.tag == sc_gluon_char_array), param });
+        }
+    });
+    library.call("listenerNewConnectionCallback", { intParam(listener) }, makeCallback([&](auto params, auto) {
+        session = params[0].data.i32;
+        library.call("sessionMessageCallback", { intParam(session) }, echoCallback);
+    }));
+    library.call("listenerStartStop", { intParam(listener), boolParam(true) });
+
+    auto client = library.call("clientInit", { stringParam(host), intParam(options.port) }).data.i32;
+    size_t numRemaining = 0;
+    Clock::time_point sentAt;
+    std::vector<double> roundTrips;
+    std::vector<uint8_t> message;
+    bool isText = false;
+    auto sendMessage = [&]() {
+        sentAt = Clock::now();
+        library.call("clientSendMessage", { intParam(client), boolParam(isText), bytesParam(message, isText) });
+    };
+    library.call("clientMessageReceivedCallback", { intParam(client) }, makeCallback([&](auto, auto numParams) {
+        for (uint32_t i = 0; i < numParams && numRemaining > 0; i += 2) {
+            roundTrips.push_back(microseconds(Clock::now() - sentAt));
+            if (--numRemaining > 0) {
+                sendMessage();
+            }
+        }
+    }));
+    bool connected = false;
+    library.call("clientConnect", { intParam(client) }, makeCallback([&](auto params, auto) {
+        connected = params[0].data.boolean;
+    }));
+    if (!gLanguage.runUntil([&]() { return connected && session >= 0; }, std::chrono::seconds(10))) {
+        fail("could not connect");
+    }
+
+    for (auto text : { false, true }) {
+        for (auto size : options.sizes) {
+            isText = text;
+            message.assign(size, 'a');
+            // warm up
+            numRemaining = std::max<size_t>(options.numRoundTrips / 10, 1);
+            sendMessage();
+            if (!gLanguage.runUntil([&]() { return numRemaining == 0; }, std::chrono::seconds(60))) {
+                fail("echo timed out");
+            }
+
+            roundTrips.clear();
+            gLanguage.callbackLatencies.clear();
+            numRemaining = options.numRoundTrips;
+            sendMessage();
+            if (!gLanguage.runUntil([&]() { return numRemaining == 0; }, std::chrono::seconds(120))) {
+                fail("echo timed out");
+            }
+            auto name = std::string(isText ? "text" : "binary") + " size=" + std::to_string(size);
+            reportLatencies(("echo " + name).c_str(), roundTrips);
+            reportLatencies(("callback " + name).c_str(), gLanguage.callbackLatencies);
+        }
+    }
+
+    library.call("clientFree", { intParam(client) });
+    library.call("listenerStartStop", { intParam(listener), boolParam(false) });
+    library.unload();
+    gLanguage.clear();
+}
+
+
+
+// an OSC message `/a 1` within `depth` nested bundles
+std::vector<uint8_t> nestedOscBundle(size_t depth) {
+    const uint8_t message[] = { '/', 'a', 0, 0, ',', 'i', 0, 0, 0, 0, 0, 1 };
+    const uint8_t bundleHeader[] = { '#', 'b', 'u', 'n', 'd', 'l', 'e', 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+    std::vector<uint8_t> packet;
+    packet.reserve(depth * (sizeof(bundleHeader) + 4) + sizeof(message));
+    for (size_t i = 0; i < depth; i++) {
+        packet.insert(packet.end(), std::begin(bundleHeader), std::end(bundleHeader));
+        // the size of the element is the size of the bundles within and the message
+        auto elementSize = static_cast<uint32_t>((depth - i - 1) * (sizeof(bundleHeader) + 4) + sizeof(message));
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            packet.push_back(static_cast<uint8_t>(elementSize >> shift));
+        }
+    }
+    packet.insert(packet.end(), std::begin(message), std::end(message));
+    return packet;
+}
+
+// bundles nested within the limit get decoded, deeper ones get passed on as a plain message
+// instead of recursing until the stack of the io thread overflows
+void checkOscNesting(GluonLibrary& library, const Options& options) {
+    std::deque<HostCallback> callbacks;
+    auto makeCallback = [&callbacks](std::function<void(const sc_gluon_param_v1_t*, uint32_t)> function) {
+        return &callbacks.emplace_back(HostCallback { std::move(function) });
+    };
+
+    library.load();
+    std::string host = "127.0.0.1";
+    auto port = options.port + 1;
+    auto listener = library.call("listenerInit", { stringParam(host), intParam(port) }).data.i32;
+    int32_t session = -1;
+    size_t numOscMessages = 0;
+    size_t numMessages = 0;
+    library.call("listenerNewConnectionCallback", { intParam(listener) }, makeCallback([&](auto params, auto) {
+        session = params[0].data.i32;
+        library.call("sessionMessageCallback", { intParam(session) }, makeCallback([&](auto, auto numParams) {
+            // every message is followed by its receive age
+            numMessages += numParams / 2;
+        }));
+        library.call("sessionOSCCallback", { intParam(session), boolParam(true) }, makeCallback([&](auto, auto) {
+            numOscMessages++;
+        }));
+    }));
+    library.call("listenerStartStop", { intParam(listener), boolParam(true) });
+
+    auto client = library.call("clientInit", { stringParam(host), intParam(port) }).data.i32;
+    library.call("clientMessageReceivedCallback", { intParam(client) }, makeCallback([](auto, auto) {}));
+    bool connected = false;
+    library.call("clientConnect", { intParam(client) }, makeCallback([&](auto params, auto) {
+        connected = params[0].data.boolean;
+    }));
+    if (!gLanguage.runUntil([&]() { return connected && session >= 0; }, std::chrono::seconds(10))) {
+        fail("could not connect");
+    }
+
+    for (auto depth : { size_t(kOscMaxBundleDepth), size_t(kOscMaxBundleDepth + 1), size_t(100000) }) {
+        auto packet = nestedOscBundle(depth);
+        library.call("clientSendMessage", { intParam(client), boolParam(false), bytesParam(packet, false) });
+    }
+    if (!gLanguage.runUntil([&]() { return numOscMessages + numMessages == 3; }, std::chrono::seconds(10))) {
+        fail("nested bundles did not arrive");
+    }
+    if (numOscMessages != 1) {
+        fail("bundles nested deeper than the limit got decoded");
+    }
+    std::printf("nested bundles beyond a depth of %d got rejected\n", kOscMaxBundleDepth);
+
+    library.call("clientFree", { intParam(client) });
+    library.call("listenerStartStop", { intParam(listener), boolParam(false) });
+    library.unload();
+    gLanguage.clear();
+}
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    auto isValid = true;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string name = argv[i];
+        if (name == "--library") {
+            options.library = argv[i + 1];
+        } else if (name == "--port") {
+            options.port = std::atoi(argv[i + 1]);
+        } else if (name == "--sizes") {
+            options.sizes = parseList(argv[i + 1]);
+        } else if (name == "--round-trips") {
+            options.numRoundTrips = std::max<size_t>(1, std::strtoull(argv[i + 1], nullptr, 10));
+        } else if (name == "--load-cycles") {
+            options.numLoadCycles = std::strtoull(argv[i + 1], nullptr, 10);
+        } else {
+            isValid = false;
+        }
+    }
+    if (!isValid || options.sizes.empty()) {
+        std::fprintf(
+            stderr,
+            "usage: ws_gluon_host [--library path] [--port N] [--sizes 16,4096,...] [--round-trips N] "
+            "[--load-cycles N]\n"
+        );
+        return 1;
+    }
+
+    GluonLibrary library(options.library);
+    benchLoad(library, options.numLoadCycles);
+    benchEcho(library, options);
+    checkOscNesting(library, options);
+    library.reportCallDurations();
+
+    // every callback object which got passed into the library has to be released once it got unloaded
+    std::printf("released %llu of %llu callback objects\n",
+                static_cast<unsigned long long>(gNumReleasedCallbacks.load()),
+                static_cast<unsigned long long>(library.numPassedCallbacks()));
+    if (gNumReleasedCallbacks != library.numPassedCallbacks()) {
+        fail("callback objects leaked or got released twice");
+    }
+    return 0;
+}
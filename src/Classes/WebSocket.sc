@@ -17,25 +17,88 @@ WebSocketServer {
 		ffi = Gluon.open(
 			pathToLibrary: PathName.new("".resolveRelative).parentPath +/+ "sclang_websocket.gluon",
 		);
+		// errors of the io threads get traced instead of printed, so post them from here
+		this.traceStream(1);
 	}
 
+	// number of threads which serve all servers and clients - can only be increased
+	// and gets limited to four times the number of cores
+	*ioThreads {|numThreads|
+		ffi.ioThreads(numThreads);
+	}
+
+	// a host of the form "unix:/path/to/socket" listens on a unix domain socket instead,
+	// which is faster for peers on the same machine - the port then only identifies the server
 	*new {|port=8080, host="0.0.0.0"|
 		var res;
-		var uuid = UniqueID.next;
-
-		// in boost beast vocabulary a server is a listener and a connection a session
-		WebSocketServer.ffi.listenerInit(uuid, host, port);
+		// in boost beast vocabulary a server is a listener and a connection a session.
+		// the library identifies its resources by handles which it hands out itself
+		var uuid = WebSocketServer.ffi.listenerInit(host, port);
 		res = super.newCopyArgs(
 			host,
 			port,
 			uuid,
 		).init;
 		all[uuid] = res;
-		^res.init;
+		^res;
 	}
 
 	init {
 		WebSocketServer.ffi.listenerNewConnectionCallback(uuid, callback: {|connectionUuid| this.prNewConnection(connectionUuid)});
+		WebSocketServer.ffi.listenerSessionRetiredCallback(uuid, callback: {|connectionUuid| this.prConnectionRetired(connectionUuid)});
+	}
+
+	// calls the callback with the number of open and retired connections and clients -
+	// closed connections and clients get removed from the library automatically
+	*handleCounts {|callback|
+		ffi.handleCounts(callback: {|numSessions, numRetiredSessions, numClients, numRetiredClients|
+			callback.value(numSessions, numRetiredSessions, numClients, numRetiredClients);
+		});
+	}
+
+	// which events of the library get traced - 0 off, 1 errors (default), 2 info, 3 every read and write
+	*traceLevel {|level=1|
+		ffi.traceLevel(level.asInteger);
+	}
+
+	// calls the callback with all events which are still in the trace buffers as lines of text
+	*traceDump {|callback|
+		ffi.traceDump(callback: {|text| (callback ? {|t| t.post}).value(text)});
+	}
+
+	// calls the callback with the events which got traced in the meantime every interval seconds,
+	// by default they get posted. an interval of nil or 0 stops it
+	*traceStream {|interval=1, callback|
+		ffi.traceStream(((interval ? 0) * 1000).asInteger, callback: {|text| (callback ? {|t| t.post}).value(text)});
+	}
+
+	// enables permessage-deflate for all connections accepted afterwards.
+	// messages smaller than minSize bytes do not get compressed.
+	compression {|enabled=true, serverMaxWindowBits=15, clientMaxWindowBits=15, noContextTakeover=false, level=8, minSize=0|
+		WebSocketServer.ffi.listenerCompression(uuid, enabled, serverMaxWindowBits, clientMaxWindowBits, noContextTakeover, level, minSize);
+	}
+
+	// connections accepted afterwards get pinged every pingInterval seconds to measure their
+	// round trip time, see WebSocketConnection:rtt. A connection which has not sent anything
+	// within idleTimeout seconds gets closed, nil keeps the default of 300 seconds
+	keepAlive {|pingInterval=1, idleTimeout|
+		WebSocketServer.ffi.listenerKeepAlive(uuid, ((pingInterval ? 0) * 1000).asInteger, ((idleTimeout ? 0) * 1000).asInteger);
+	}
+
+	// calls the callback with a Dictionary which maps the JSON pointers of the counters of
+	// the server and all its open connections to their values, e.g. "/openSessions" -> 2,
+	// see the README for the fields
+	stats {|callback|
+		WebSocketServer.ffi.listenerStats(uuid, callback: {|...fields|
+			callback.value(WebSocketServer.prJSONFieldsToDictionary(fields));
+		});
+	}
+
+	// calls the callback with the stats every interval seconds, an interval of nil or 0 stops it
+	statsInterval {|interval, callback|
+		WebSocketServer.ffi.listenerStatsInterval(uuid, ((interval ? 0) * 1000).asInteger, callback: {|...fields|
+			callback.value(WebSocketServer.prJSONFieldsToDictionary(fields));
+		});
 	}
 
 	start {|onStart|
@@ -47,10 +110,128 @@ WebSocketServer {
 	}
 
 	broadcast {|message|
-		// @todo only send to open connections
-		connections.do({|connection|
-			connection.send(message);
+		// the library keeps track of the open connections itself
+		WebSocketServer.ffi.listenerBroadcast(uuid, message.isKindOf(String), message);
+	}
+
+	// sends the message to all connections which subscribed to the topic
+	publish {|topic, message|
+		WebSocketServer.ffi.listenerPublish(uuid, topic.asString, message.isKindOf(String), message);
+	}
+
+	// lets connections (un)subscribe and publish to topics themselves via frames of the form
+	// "#sub <topic>", "#unsub <topic>" and "#pub <topic>\n<message>", so messages between
+	// connections get relayed by the library without passing through sclang.
+	// Applies to all connections accepted afterwards.
+	topicControlFrames {|enabled=true|
+		WebSocketServer.ffi.listenerTopicControlFrames(uuid, enabled);
+	}
+
+	// forwards the binary messages of all connections accepted afterwards to a UDP
+	// address, e.g. NetAddr("127.0.0.1", 57110) of scsynth, without passing them
+	// through sclang. Replies get sent back to the originating connection.
+	// Messages which start with one of the mirrorPrefixes, e.g. ["/status"],
+	// still get passed on to sclang. A nil address disables relaying.
+	udpRelay {|netAddr, mirrorPrefixes|
+		WebSocketServer.ffi.listenerUdpRelay(
+			uuid,
+			netAddr !? {netAddr.ip} ? "",
+			netAddr !? {netAddr.port} ? 0,
+			mirrorPrefixes.asArray.collect(_.asString).join($\n),
+		);
+	}
+
+	// packs multiple messages into a single Int8Array, so they can be sent
+	// with one call into the library - see `unpackBatch` for the layout
+	*packBatch {|messages|
+		var batch = Int8Array.new(messages.sum({|message| message.size + 5}));
+		messages.do({|message|
+			var numBytes = message.size;
+			batch = batch.add(message.isKindOf(String).binaryValue);
+			[24, 16, 8, 0].do({|shift|
+				var byte = (numBytes >> shift) & 255;
+				batch = batch.add(if(byte > 127, {byte - 256}, {byte}));
+			});
+			batch = batch.addAll(if(message.isKindOf(String), {message.ascii}, {message}));
 		});
+		^batch;
+	}
+
+	// serializes Dictionaries, Arrays, Strings, Symbols, Numbers, Booleans and nil as JSON
+	*toJSON {|object|
+		^case
+		{object.isNil} {"null"}
+		{object.isKindOf(Boolean)} {object.asString}
+		{object.isKindOf(Number)} {
+			if(object.isNaN or: {object.abs == inf}, {"null"}, {object.asString});
+		}
+		{object.isKindOf(String) or: {object.isKindOf(Symbol)}} {
+			var escaped = CollStream();
+			object.asString.do({|char|
+				escaped << switch(char,
+					$\\, {"\\\\"},
+					$", {"\\\""},
+					$\n, {"\\n"},
+					$\r, {"\\r"},
+					$\t, {"\\t"},
+					{
+						// other control characters are not allowed within JSON strings.
+						// bytes of multibyte UTF-8 characters have a negative ascii value
+						if(char.ascii.inclusivelyBetween(0, 31), {"\\u%".format(char.ascii.asHexString(4))}, {char});
+					}
+				);
+			});
+			"\"%\"".format(escaped.contents);
+		}
+		{object.isKindOf(Dictionary)} {
+			"{%}".format(object.asAssociations.collect({|association|
+				"%:%".format(this.toJSON(association.key.asString), this.toJSON(association.value));
+			}).join(","));
+		}
+		{object.isKindOf(SequenceableCollection)} {
+			"[%]".format(object.collect({|item| this.toJSON(item)}).join(","));
+		}
+		{Error("Can not serialize % as JSON".format(object)).throw};
+	}
+
+	// the library passes decoded JSON as pointer/value pairs, see `doJsonCallback`
+	*prJSONFieldsToDictionary {|fields|
+		var dictionary = Dictionary();
+		fields.pairsDo({|pointer, value|
+			// empty objects and arrays are passed as markers
+			if(value.isKindOf(Int8Array), {
+				value = if(value[0] == ${.ascii, {Dictionary()}, {[]});
+			});
+			dictionary[pointer] = value;
+		});
+		^dictionary;
+	}
+
+	// the round trip times of the stats are in microseconds
+	*prRttFromStats {|stats|
+		^(
+			samples: stats["/rtt/samples"].asInteger,
+			latest: stats["/rtt/latest"].asFloat * 1e-6,
+			min: stats["/rtt/min"].asFloat * 1e-6,
+			avg: stats["/rtt/avg"].asFloat * 1e-6,
+			p99: stats["/rtt/p99"].asFloat * 1e-6,
+		);
+	}
+
+	*prQueuePolicyIndex {|policy|
+		^[\reject, \dropOldest, \dropNewest, \disconnect].indexOf(policy) ?? {
+			Error("Unknown queue policy %".format(policy)).throw;
+		};
+	}
+
+	// the library takes the delay in microseconds as a 32 bit integer, which limits
+	// scheduling to about 35 minutes ahead - later times get rejected instead of wrapping around
+	*prSendAtDelay {|time|
+		var delay = time - Main.elapsedTime;
+		if(delay > 2147.483647, {
+			Error("Can only schedule a message up to 2147 seconds ahead, not %".format(delay)).throw;
+		});
+		^(max(delay, 0) * 1e6).asInteger;
 	}
 
 	prNewConnection {|connectionUuid|
@@ -62,6 +243,12 @@ WebSocketServer {
 		connections = connections.add(connection);
 		onConnection.value(connection);
 	}
+
+	// the connection has been closed and removed from the library
+	prConnectionRetired {|connectionUuid|
+		var connection = WebSocketConnection.all.removeAt(connectionUuid);
+		connections.remove(connection);
+	}
 }
 
 WebSocketConnection {
@@ -69,8 +256,19 @@ WebSocketConnection {
 	var <uuid;
 
 	var <connected = false;
+	// gets called with the message and the seconds it spent in the IO thread before being
+	// handed to sclang, e.g. in a message batch - the time waiting for sclang is not included
 	var <>onMessage;
 	var <>onDisconnect;
+	// gets called with the decoded message as [address, ...args] and the
+	// delay of its bundle timetag in seconds, see oscDecoding
+	var <>onOSC;
+	// gets called with a Dictionary which maps the JSON pointers of the received
+	// values to the values, e.g. "/user/name" -> "foo", see jsonDecoding
+	var <>onJSON;
+	// gets called with true if the send queue crossed its high watermark
+	// and with false once it has drained below its low watermark
+	var <>onQueueStateChange;
 
 	classvar <>all;
 
@@ -86,20 +284,124 @@ WebSocketConnection {
 
 	init {
 		WebSocketServer.ffi.sessionConnectionStateCallback(uuid, callback: {|isConnected| this.prConnectionStateChanged(isConnected)});
-		WebSocketServer.ffi.sessionMessageCallback(uuid, callback: {|message| this.prMessageReceived(message)});
+		WebSocketServer.ffi.sessionQueueStateCallback(uuid, callback: {|isAboveHighWatermark| onQueueStateChange.value(isAboveHighWatermark)});
+		// multiple messages get passed as arguments if message batching is enabled,
+		// each one followed by the seconds since it has been received, measured when the
+		// batch gets handed to sclang
+		WebSocketServer.ffi.sessionMessageCallback(uuid, callback: {|...messages|
+			messages.pairsDo({|message, age| this.prMessageReceived(message, age)});
+		});
 	}
 
+	// returns false if the message got rejected by a full send queue
 	send {|message|
-		WebSocketServer.ffi.sessionSendMessage(uuid, message.isKindOf(String), message);
+		^WebSocketServer.ffi.sessionSendMessage(uuid, message.isKindOf(String), message);
+	}
+
+	// sends the message at a time in seconds of Main.elapsedTime, e.g. thisThread.seconds + latency
+	// sends it with a fixed latency after the logical time of a routine, like s.bind does for scsynth.
+	// The message gets held by the IO thread, so the time it gets sent at does not depend on sclang.
+	// The time can be at most 2147 seconds ahead.
+	sendAt {|message, time|
+		WebSocketServer.ffi.sessionSendAt(uuid, WebSocketServer.prSendAtDelay(time), message.isKindOf(String), message);
+	}
+
+	// sends an OSC message which gets encoded by the asRawOSC primitive
+	sendOSC {|...msg|
+		^this.send(msg.asRawOSC);
+	}
+
+	// binary messages which are valid OSC get decoded by the library
+	// and passed to onOSC instead of onMessage
+	oscDecoding {|enabled=true|
+		WebSocketServer.ffi.sessionOSCCallback(uuid, enabled, callback: {|delay ...msg|
+			msg[0] = msg[0].asSymbol;
+			onOSC.value(msg, delay);
+		});
+	}
+
+	// text messages which are valid JSON get decoded by the library and passed
+	// to onJSON instead of onMessage. If pointers are given, e.g. ["/user/name"],
+	// only the values below these pointers get passed on.
+	jsonDecoding {|enabled=true, pointers|
+		WebSocketServer.ffi.sessionJSONCallback(uuid, enabled, pointers.asArray.join($\n), callback: {|...fields|
+			onJSON.value(WebSocketServer.prJSONFieldsToDictionary(fields));
+		});
+	}
+
+	sendJSON {|object|
+		^this.send(WebSocketServer.toJSON(object));
+	}
+
+	// a message which is still waiting in the send queue with the same key gets
+	// replaced, so a slow connection only receives the latest message per key
+	sendKeyed {|key, message|
+		WebSocketServer.ffi.sessionSendKeyed(uuid, key.asString, message.isKindOf(String), message);
+	}
+
+	// see WebSocketServer:udpRelay
+	udpRelay {|netAddr, mirrorPrefixes|
+		WebSocketServer.ffi.sessionUdpRelay(
+			uuid,
+			netAddr !? {netAddr.ip} ? "",
+			netAddr !? {netAddr.port} ? 0,
+			mirrorPrefixes.asArray.collect(_.asString).join($\n),
+		);
+	}
+
+	// see WebSocketServer:publish
+	subscribe {|topic|
+		WebSocketServer.ffi.sessionSubscribe(uuid, topic.asString, true);
+	}
+
+	unsubscribe {|topic|
+		WebSocketServer.ffi.sessionSubscribe(uuid, topic.asString, false);
+	}
+
+	// sends an array of messages with a single call into the library
+	sendBatch {|messages|
+		WebSocketServer.ffi.sessionSendBatch(uuid, WebSocketServer.packBatch(messages));
+	}
+
+	// delivers received messages in batches, which get flushed after maxMessages,
+	// maxBytes or maxLatency seconds. A maxMessages of 1 disables batching.
+	messageBatching {|maxMessages=64, maxBytes=65536, maxLatency=0.002|
+		WebSocketServer.ffi.sessionMessageBatching(uuid, maxMessages, maxBytes, (maxLatency * 1e6).asInteger);
+	}
+
+	// limits the send queue of the connection, a limit of 0 is unlimited.
+	// policy can be \reject, \dropOldest, \dropNewest or \disconnect.
+	// watermarks are in bytes, disconnectTimeout in seconds.
+	queueLimits {|maxMessages=0, maxBytes=0, policy=\reject, highWatermark=0, lowWatermark=0, disconnectTimeout=5|
+		WebSocketServer.ffi.sessionQueueLimits(uuid, maxMessages, maxBytes, WebSocketServer.prQueuePolicyIndex(policy), highWatermark, lowWatermark, (disconnectTimeout * 1000).asInteger);
+	}
+
+	// calls back with the ratio of message bytes to bytes on the wire
+	// for received and sent messages
+	compressionRatio {|callback|
+		WebSocketServer.ffi.sessionCompressionStats(uuid, callback: callback);
+	}
+
+	// see WebSocketServer:stats
+	stats {|callback|
+		WebSocketServer.ffi.sessionStats(uuid, callback: {|...fields|
+			callback.value(WebSocketServer.prJSONFieldsToDictionary(fields));
+		});
+	}
+
+	// calls the callback with an Event of the round trip times of the latest pings in seconds -
+	// latest, min, avg and p99 - and the number of samples, see WebSocketServer:keepAlive
+	rtt {|callback|
+		this.stats({|stats| callback.value(WebSocketServer.prRttFromStats(stats))});
 	}
 
 	close {
 		WebSocketServer.ffi.sessionClose(uuid);
 	}
 
-	prMessageReceived {|message|
+	prMessageReceived {|message, age|
 		"Received message %".format(message).postln;
-		onMessage.value(message);
+		onMessage.value(message, age);
 	}
 
 	prConnectionStateChanged {|isConnected|
@@ -114,50 +416,182 @@ WebSocketConnection {
 WebSocketClient {
 	var <host;
 	var <port;
-	// we identify resources of the ffi using uuids
+	// handle of the client within the library
 	var <uuid;
 
 	var <connected = false;
+	// true while the client waits to reconnect, see reconnect
+	var <reconnecting = false;
+	// counts the established connections, starting at 1
+	var <epoch = 0;
+	// see WebSocketConnection:onMessage
 	var <>onMessage;
+	// see WebSocketConnection:onOSC
+	var <>onOSC;
+	// see WebSocketConnection:onJSON
+	var <>onJSON;
+	// see WebSocketConnection:onQueueStateChange
+	var <>onQueueStateChange;
 
+	// a host of the form "unix:/path/to/socket" connects to a unix domain socket, see WebSocketServer:new
 	*new {|host="127.0.0.1", port=8765|
-		var uuid = UniqueID.next;
-		WebSocketServer.ffi.clientInit(uuid, host, port);
+		var uuid = WebSocketServer.ffi.clientInit(host, port);
 		^super.newCopyArgs(host, port, uuid).init;
 	}
 
 	init {
-		WebSocketServer.ffi.clientMessageReceivedCallback(uuid, callback: {|message| this.prMessageReceived(message)});
+		WebSocketServer.ffi.clientQueueStateCallback(uuid, callback: {|isAboveHighWatermark| onQueueStateChange.value(isAboveHighWatermark)});
+		// multiple messages get passed as arguments if message batching is enabled
+		WebSocketServer.ffi.clientMessageReceivedCallback(uuid, callback: {|...messages|
+			messages.pairsDo({|message, age| this.prMessageReceived(message, age)});
+		});
+	}
+
+	// see WebSocketServer:compression - needs to be set before connecting
+	compression {|enabled=true, serverMaxWindowBits=15, clientMaxWindowBits=15, noContextTakeover=false, level=8, minSize=0|
+		WebSocketServer.ffi.clientCompression(uuid, enabled, serverMaxWindowBits, clientMaxWindowBits, noContextTakeover, level, minSize);
+	}
+
+	// see WebSocketServer:keepAlive - nil as idleTimeout never closes an idle connection
+	keepAlive {|pingInterval=1, idleTimeout|
+		WebSocketServer.ffi.clientKeepAlive(uuid, ((pingInterval ? 0) * 1000).asInteger, ((idleTimeout ? 0) * 1000).asInteger);
+	}
+
+	// see WebSocketConnection:rtt
+	rtt {|callback|
+		this.stats({|stats| callback.value(WebSocketServer.prRttFromStats(stats))});
+	}
+
+	// see WebSocketConnection:compressionRatio
+	compressionRatio {|callback|
+		WebSocketServer.ffi.clientCompressionStats(uuid, callback: callback);
+	}
+
+	// see WebSocketServer:stats
+	stats {|callback|
+		WebSocketServer.ffi.clientStats(uuid, callback: {|...fields|
+			callback.value(WebSocketServer.prJSONFieldsToDictionary(fields));
+		});
+	}
+
+	// see WebSocketServer:statsInterval
+	statsInterval {|interval, callback|
+		WebSocketServer.ffi.clientStatsInterval(uuid, ((interval ? 0) * 1000).asInteger, callback: {|...fields|
+			callback.value(WebSocketServer.prJSONFieldsToDictionary(fields));
+		});
+	}
+
+	// connects again with a jittered exponential backoff after a connection attempt failed
+	// or the connection dropped. Delays are in seconds and a maxAttempts of 0 retries forever.
+	// Messages which get sent in the meantime are held and sent once reconnected, beyond
+	// maxHeldMessages the oldest get dropped. Needs to be called before connecting.
+	reconnect {|enabled=true, initialDelay=0.01, maxDelay=5, multiplier=2, jitter=0.5, maxAttempts=0, maxHeldMessages=1024|
+		WebSocketServer.ffi.clientReconnect(uuid, enabled, (initialDelay * 1000).asInteger, (maxDelay * 1000).asInteger, multiplier.asFloat, jitter.asFloat, maxAttempts.asInteger, maxHeldMessages.asInteger);
 	}
 
+	// onConnectionChange gets called with the connection status, the epoch of the
+	// connection and whether the client is going to reconnect
 	connect {|onConnectionChange|
-		WebSocketServer.ffi.clientConnect(uuid, callback: {|connectionStatus|
+		WebSocketServer.ffi.clientConnect(uuid, callback: {|connectionStatus, connectionEpoch, willReconnect|
 			"Connection status is now %".format(connectionStatus).postln;
 			connected = connectionStatus;
-			onConnectionChange.value(connectionStatus);
+			epoch = connectionEpoch;
+			reconnecting = willReconnect;
+			onConnectionChange.value(connectionStatus, connectionEpoch, willReconnect);
 		});
 	}
 
 	send {|message|
-		if(connected.not, {
+		if(connected.not and: { reconnecting.not }, {
 			"Can only send a message on an open connection".warn;
 			^this;
 		});
-		WebSocketServer.ffi.clientSendMessage(uuid, message.isKindOf(String), message);
+		^WebSocketServer.ffi.clientSendMessage(uuid, message.isKindOf(String), message);
 	}
 
-	prMessageReceived {|message|
+	// see WebSocketConnection:sendAt - messages which are due while reconnecting get held
+	sendAt {|message, time|
+		if(connected.not and: { reconnecting.not }, {
+			"Can only send a message on an open connection".warn;
+			^this;
+		});
+		WebSocketServer.ffi.clientSendAt(uuid, WebSocketServer.prSendAtDelay(time), message.isKindOf(String), message);
+	}
+
+	// see WebSocketConnection:sendOSC
+	sendOSC {|...msg|
+		^this.send(msg.asRawOSC);
+	}
+
+	// see WebSocketConnection:oscDecoding
+	oscDecoding {|enabled=true|
+		WebSocketServer.ffi.clientOSCCallback(uuid, enabled, callback: {|delay ...msg|
+			msg[0] = msg[0].asSymbol;
+			onOSC.value(msg, delay);
+		});
+	}
+
+	// see WebSocketConnection:jsonDecoding
+	jsonDecoding {|enabled=true, pointers|
+		WebSocketServer.ffi.clientJSONCallback(uuid, enabled, pointers.asArray.join($\n), callback: {|...fields|
+			onJSON.value(WebSocketServer.prJSONFieldsToDictionary(fields));
+		});
+	}
+
+	// see WebSocketConnection:sendJSON
+	sendJSON {|object|
+		^this.send(WebSocketServer.toJSON(object));
+	}
+
+	// see WebSocketConnection:sendKeyed
+	sendKeyed {|key, message|
+		if(connected.not and: { reconnecting.not }, {
+			"Can only send a message on an open connection".warn;
+			^this;
+		});
+		WebSocketServer.ffi.clientSendKeyed(uuid, key.asString, message.isKindOf(String), message);
+	}
+
+	// sends an array of messages with a single call into the library
+	sendBatch {|messages|
+		if(connected.not and: { reconnecting.not }, {
+			"Can only send a message on an open connection".warn;
+			^this;
+		});
+		WebSocketServer.ffi.clientSendBatch(uuid, WebSocketServer.packBatch(messages));
+	}
+
+	// see WebSocketConnection:queueLimits
+	queueLimits {|maxMessages=0, maxBytes=0, policy=\reject, highWatermark=0, lowWatermark=0, disconnectTimeout=5|
+		WebSocketServer.ffi.clientQueueLimits(uuid, maxMessages, maxBytes, WebSocketServer.prQueuePolicyIndex(policy), highWatermark, lowWatermark, (disconnectTimeout * 1000).asInteger);
+	}
+
+	// see WebSocketConnection:messageBatching
+	messageBatching {|maxMessages=64, maxBytes=65536, maxLatency=0.002|
+		WebSocketServer.ffi.clientMessageBatching(uuid, maxMessages, maxBytes, (maxLatency * 1e6).asInteger);
+	}
+
+	prMessageReceived {|message, age|
 		"Client has received a message %".format(message).postln;
-		onMessage.value(message);
+		onMessage.value(message, age);
 	}
 
 	close {
-		if(connected.not, {
+		if(connected.not and: { reconnecting.not }, {
 			"Can only close an open connection".warn;
 			^this;
 		});
 
 		WebSocketServer.ffi.clientCloseConnection(uuid);
 		connected = false;
+		reconnecting = false;
+	}
+
+	// closes the connection and releases the client in the library - a closed
+	// client gets released automatically, so a new client is needed to reconnect
+	free {
+		WebSocketServer.ffi.clientFree(uuid);
+		connected = false;
+		reconnecting = false;
 	}
 }
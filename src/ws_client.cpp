@@ -1,9 +1,11 @@
 #include "ws_client.h"
 
 #include "ws_server.h"
+#include "ws_trace.h"
 #include "boost/asio/strand.hpp"
 
-#include <iostream>
+#include <algorithm>
+#include <cmath>
 
 
 namespace beast = boost::beast;
@@ -13,118 +15,467 @@ using tcp = boost::asio::ip::tcp;
 WebSocketClient::WebSocketClient(boost::asio::io_context& ioContext, std::string host, int port):
     mHost(host),
     mPort(port),
+    mLocalPath(localSocketPath(mHost)),
     mIoContext(ioContext),
-    mResolver(boost::asio::make_strand(mIoContext)),
-    mWs(boost::asio::make_strand(mIoContext))
+    mStrand(boost::asio::make_strand(mIoContext)),
+    mResolver(mStrand),
+    mWs(mStrand, !mLocalPath.empty()),
+    // the batcher is a member, so it can not outlive the client
+    mBatcher(mStrand, [this](const WebSocketDataView* messages, size_t numMessages) {
+        mSclangOnMessageCallback(messages, numMessages);
+    }),
+    mReconnectTimer(mStrand),
+    mRandom(std::random_device()()),
+    mOutQueue(
+        mStrand,
+        [this](bool isAboveHighWatermark) {
+            if (mSclangQueueStateCallback) {
+                mSclangQueueStateCallback(isAboveHighWatermark);
+            }
+        },
+        // a slow consumer gets disconnected
+        [this]() {
+            mStats.setDisconnectReason(DisconnectReason::slowConsumer);
+            closeConnection();
+        }
+    ),
+    mScheduledSends(mStrand, [this](WebSocketPayload message) {
+        mOutQueue.push(std::move(message), shared_from_this());
+        doWrite();
+    }),
+    mStatsTimer(mStrand),
+    mPingTimer(mStrand)
 {
-    std::cout << "ioContext address = " << &ioContext << std::endl;
 }
 
 void WebSocketClient::connect() {
-    if (mSclangConnectionChangeCallback == nullptr || mSclangOnMessageCallback == nullptr) {
-        std::cerr << "Provide a connection change and message callback for WebSocket client before connecting!" << std::endl;
+    // callbacks get installed on the strand, so check them there
+    boost::asio::dispatch(mStrand, [self = shared_from_this()]() {
+        if (self->mSclangConnectionChangeCallback == nullptr || self->mSclangOnMessageCallback == nullptr) {
+            // the sclang wrapper always installs both callbacks
+            trace(TraceEvent::clientMissingCallbacks, self->mHandle);
+            return;
+        }
+        self->startConnect();
+    });
+}
+
+void WebSocketClient::startConnect() {
+    if (mClosed) {
+        mConnecting = false;
+        reconnectOrClose(false);
+        return;
+    }
+    mConnecting = true;
+    // the stream gets reused, so the pending operations of the previous connection have to be finished
+    if (mIsWriting || mPingPending) {
+        // continued by `resumeDeferredConnect` from their completion handlers
+        mConnectDeferred = true;
+        return;
+    }
+    mBuffer.consume(mBuffer.size());
+    auto& socket = beast::get_lowest_layer(mWs);
+    if (!mLocalPath.empty()) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        if (isLocalSocketPathTooLong(mLocalPath)) {
+            onSocketConnect(boost::asio::error::name_too_long, {});
+            return;
+        }
+        socket.localSocket().async_connect(
+            boost::asio::local::stream_protocol::endpoint(mLocalPath),
+            [self = shared_from_this()](beast::error_code ec) {
+                // a unix domain socket has no host name, so use the one of the loopback
+                self->onSocketConnect(ec, "localhost");
+            }
+        );
+#else
+        onSocketConnect(boost::asio::error::operation_not_supported, {});
+#endif
+        return;
+    }
+    if (!mEndpoints.empty()) {
+        boost::asio::async_connect(
+            socket.tcpSocket(), mEndpoints, beast::bind_front_handler(&WebSocketClient::onConnect, shared_from_this()));
         return;
     }
     mResolver.async_resolve(
-        mHost,
-        std::to_string(mPort),
-        beast::bind_front_handler(&WebSocketClient::onResolve, shared_from_this())
+        mHost, std::to_string(mPort), beast::bind_front_handler(&WebSocketClient::onResolve, shared_from_this()));
+}
+
+void WebSocketClient::runOnStrand(std::function<void()> function) {
+    boost::asio::dispatch(mStrand, [function = std::move(function), self = shared_from_this()]() { function(); });
+}
+
+void WebSocketClient::closeConnection() {
+    boost::asio::dispatch(mStrand, [self = shared_from_this()]() {
+        if (self->mClosed) {
+            return;
+        }
+        self->mClosed = true;
+        self->mStats.setDisconnectReason(DisconnectReason::local);
+        self->mStatsTimer.stop();
+        self->mPingTimer.stop();
+        self->mScheduledSends.cancel();
+        if (self->mConnected) {
+            self->mWs.async_close(beast::websocket::close_code::normal,
+                                  beast::bind_front_handler(&WebSocketClient::onClose, self));
+        } else if (self->mConnecting) {
+            // the pending attempt fails and reports the client as closed
+            self->mReconnectTimer.cancel();
+            self->mResolver.cancel();
+            beast::get_lowest_layer(self->mWs).cancel();
+        }
+    });
+}
+
+void WebSocketClient::setKeepAlive(const KeepAliveOptions& keepAlive) {
+    boost::asio::dispatch(mStrand, [keepAlive, self = shared_from_this()]() {
+        self->mKeepAlive = keepAlive;
+    });
+}
+
+void WebSocketClient::setReconnectPolicy(const ReconnectPolicy& policy) {
+    boost::asio::dispatch(mStrand, [policy, self = shared_from_this()]() {
+        self->mReconnectPolicy = policy;
+    });
+}
+
+void WebSocketClient::setMessageBatching(size_t maxMessages, size_t maxBytes, std::chrono::microseconds maxLatency) {
+    boost::asio::dispatch(mStrand, [=, self = shared_from_this()]() {
+        self->mBatcher.configure(maxMessages, maxBytes, maxLatency);
+    });
+}
+
+void WebSocketClient::setQueueLimits(const QueueLimits& limits) {
+    boost::asio::dispatch(mStrand, [=, self = shared_from_this()]() {
+        self->mOutQueue.configure(limits);
+    });
+}
+
+void WebSocketClient::setJsonPointers(std::vector<std::string> pointers) {
+    boost::asio::dispatch(mStrand, [pointers = std::move(pointers), self = shared_from_this()]() mutable {
+        self->mJsonDecoder.setPointers(std::move(pointers));
+    });
+}
+
+void WebSocketClient::setCompression(const beast::websocket::permessage_deflate& compression) {
+    boost::asio::dispatch(mStrand, [compression, self = shared_from_this()]() {
+        self->mWs.set_option(compression);
+    });
+}
+
+CompressionStats WebSocketClient::getCompressionStats() const {
+    auto& wireCounters = mWs.next_layer().counters();
+    return CompressionStats{
+        .messageBytesRead = mStats.bytesRead.load(std::memory_order_relaxed),
+        .messageBytesWritten = mStats.bytesWritten.load(std::memory_order_relaxed),
+        .wireBytesRead = wireCounters.bytesRead.load(std::memory_order_relaxed),
+        .wireBytesWritten = wireCounters.bytesWritten.load(std::memory_order_relaxed),
+    };
+}
+
+std::string WebSocketClient::getStatsJson() const {
+    auto& wireCounters = mWs.next_layer().counters();
+    return connectionStatsToJson(
+        mStats,
+        mOutQueue.getStats(),
+        WireStats{
+            .bytesRead = wireCounters.bytesRead.load(std::memory_order_relaxed),
+            .bytesWritten = wireCounters.bytesWritten.load(std::memory_order_relaxed),
+        }
     );
 }
 
-beast::error_code WebSocketClient::closeConnection() {
-    beast::error_code ec;
-    mWs.close(beast::websocket::close_code::normal, ec);
-    return ec;
+void WebSocketClient::setStatsInterval(std::chrono::milliseconds interval, StatsCallback callback) {
+    boost::asio::dispatch(mStrand, [=, self = shared_from_this()]() {
+        self->mStatsTimer.start(interval, [self = self.get(), callback]() { callback(self->getStatsJson()); }, self);
+    });
+}
+
+void WebSocketClient::onClose(beast::error_code ec) {
+    mConnected = false;
+    if (ec) {
+        trace(TraceEvent::clientCloseFailed, mHandle, ec);
+    }
+}
+
+bool WebSocketClient::enqueueMessage(WebSocketPayload message) {
+    // the common case neither allocates nor wakes up the strand more than once per burst
+    auto isPushed = mSubmissions.push(message);
+    if (!isPushed && !mSubmissions.isBypassing()) {
+        // the ring is full, so the strand is behind - apply the overflow policy right here
+        if (mOutQueue.dropsOnOverflow()) {
+            mOutQueue.recordDropped();
+            return false;
+        }
+        // an io thread must not wait, as it may have to run the strand which makes room
+        if (!runsOnIoThread(mWs.get_executor())) {
+            isPushed = mSubmissions.pushWaiting(message);
+        }
+    }
+    if (isPushed) {
+        if (mSubmissions.needsWakeup()) {
+            boost::asio::post(
+                mWs.get_executor(),
+                bindHandlerMemory(mSubmitMemory, [self = shared_from_this()]() { self->drainSubmissions(); })
+            );
+        }
+        return true;
+    }
+    dispatchOrdered([message = std::move(message)](WebSocketClient& self) mutable {
+        self.mOutQueue.push(std::move(message), self.shared_from_this());
+    });
+    return true;
+}
+
+void WebSocketClient::enqueueKeyedMessage(std::string key, WebSocketPayload message) {
+    dispatchOrdered([key = std::move(key), message = std::move(message)](WebSocketClient& self) mutable {
+        self.mOutQueue.push(std::move(message), self.shared_from_this(), std::move(key));
+    });
 }
 
-void WebSocketClient::enqueueMessage(WebSocketData& message) {
-    // dispatch via asio to ensure thread safety
-    boost::asio::dispatch(mWs.get_executor(), [message, self = shared_from_this()]() mutable {
-        self->mOutQueue.push(message);
-        self->doWrite();
+void WebSocketClient::enqueueMessages(std::vector<WebSocketPayload> messages) {
+    // a single dispatch for the whole batch
+    dispatchOrdered([messages = std::move(messages)](WebSocketClient& self) mutable {
+        auto keepAlive = self.shared_from_this();
+        for (auto& message : messages) {
+            self.mOutQueue.push(std::move(message), keepAlive);
+        }
     });
 }
 
+void WebSocketClient::enqueueMessageAt(std::chrono::steady_clock::time_point time, WebSocketPayload message) {
+    dispatchOrdered([time, message = std::move(message)](WebSocketClient& self) mutable {
+        if (!self.mClosed) {
+            self.mScheduledSends.schedule(time, std::move(message), self.shared_from_this());
+        }
+    });
+}
+
+template <class Function>
+void WebSocketClient::dispatchOrdered(Function&& function) {
+    mSubmissions.beginBypass();
+    boost::asio::dispatch(
+        mWs.get_executor(),
+        [function = std::forward<Function>(function), self = shared_from_this()]() mutable {
+            // messages which have been submitted before go first
+            self->drainSubmissions();
+            function(*self);
+            self->mSubmissions.endBypass();
+            self->doWrite();
+        }
+    );
+}
+
+void WebSocketClient::drainSubmissions() {
+    auto self = shared_from_this();
+    mSubmissions.drain([&self, this](WebSocketPayload message) { mOutQueue.push(std::move(message), self); });
+    doWrite();
+}
+
 void WebSocketClient::onResolve(beast::error_code ec, boost::asio::ip::tcp::resolver::results_type results) {
     if (ec) {
-        std::cout << "Could not resolve host: " << ec.message().c_str() << std::endl;
+        trace(TraceEvent::clientResolveFailed, mHandle, ec);
+        mStats.connectFailures.fetch_add(1, std::memory_order_relaxed);
+        mConnecting = false;
+        reconnectOrClose(false);
         return;
     }
-    beast::get_lowest_layer(mWs).async_connect(
-        results, beast::bind_front_handler(&WebSocketClient::onConnect, shared_from_this()));
+    mEndpoints = results;
+    boost::asio::async_connect(beast::get_lowest_layer(mWs).tcpSocket(), results,
+                               beast::bind_front_handler(&WebSocketClient::onConnect, shared_from_this()));
 }
 
 void WebSocketClient::onConnect(beast::error_code ec,
                                 boost::asio::ip::tcp::resolver::results_type::endpoint_type endpoint) {
     if (ec) {
-        std::cout << "Could not connect to host: " << ec.message().c_str() << std::endl;
+        // the host may have moved, so the next attempt resolves it again
+        mEndpoints = {};
+    }
+    // The value of the Host HTTP header during the WebSocket handshake.
+    // See https://tools.ietf.org/html/rfc7230#section-5.4
+    onSocketConnect(ec, mHost + ':' + std::to_string(endpoint.port()));
+}
+
+void WebSocketClient::onSocketConnect(beast::error_code ec, const std::string& host) {
+    if (ec) {
+        trace(TraceEvent::clientConnectFailed, mHandle, ec);
+        mStats.connectFailures.fetch_add(1, std::memory_order_relaxed);
+        mConnecting = false;
+        reconnectOrClose(false);
         return;
     }
+    beast::get_lowest_layer(mWs).setNoDelay();
+    mWs.set_option(keepAliveTimeout(mKeepAlive, beast::role_type::client));
+    mWs.control_callback([this](beast::websocket::frame_type kind, beast::string_view payload) {
+        if (kind == beast::websocket::frame_type::pong) {
+            recordPong(mStats.rtt, payload);
+        }
+    });
     // Set a decorator to change the User-Agent of the handshake
     mWs.set_option(beast::websocket::stream_base::decorator([](beast::websocket::request_type& req) {
         req.set(beast::http::field::user_agent, std::string("sclang websocket-client"));
     }));
 
-    // Update the host_ string. This will provide the value of the
-    // Host HTTP header during the WebSocket handshake.
-    // See https://tools.ietf.org/html/rfc7230#section-5.4
-    mHost += ':' + std::to_string(endpoint.port());
-
     // Perform the websocket handshake
-    mWs.async_handshake(mHost, "/", beast::bind_front_handler(&WebSocketClient::onHandshake, shared_from_this()));
+    mWs.async_handshake(host, "/", beast::bind_front_handler(&WebSocketClient::onHandshake, shared_from_this()));
 }
 
 void WebSocketClient::onHandshake(beast::error_code ec) {
+    mConnecting = false;
     if (ec) {
-        std::cout << "Could not handshake: " << ec.message().c_str() << std::endl;
+        trace(TraceEvent::clientHandshakeFailed, mHandle, ec);
+        mStats.connectFailures.fetch_add(1, std::memory_order_relaxed);
+        reconnectOrClose(false);
+        return;
     }
+    if (mClosed) {
+        // got closed while the handshake was completing
+        beast::get_lowest_layer(mWs).close();
+        reconnectOrClose(false);
+        return;
+    }
+    trace(TraceEvent::clientConnected, mHandle);
+    mEpoch++;
     mConnected = true;
-    mSclangConnectionChangeCallback(true);
+    mNumAttempts = 0;
+    // the reason is reported for the latest connection
+    mStats.disconnectReason.store(static_cast<int>(DisconnectReason::none), std::memory_order_relaxed);
+    mSclangConnectionChangeCallback(true, mEpoch, false);
+    mPingTimer.start(mKeepAlive.pingInterval, [this]() { sendPing(); }, shared_from_this());
     doRead();
+    // send out what has been held while disconnected
+    doWrite();
+}
+
+void WebSocketClient::sendPing() {
+    if (mPingPending) {
+        return;
+    }
+    mPingPending = true;
+    mWs.async_ping(makePingPayload(), [self = shared_from_this()](beast::error_code) {
+        self->mPingPending = false;
+        self->resumeDeferredConnect();
+    });
+}
+
+void WebSocketClient::resumeDeferredConnect() {
+    if (mConnectDeferred && !mIsWriting && !mPingPending) {
+        mConnectDeferred = false;
+        startConnect();
+    }
+}
+
+void WebSocketClient::reconnectOrClose(bool wasConnected) {
+    auto willReconnect = !mClosed && mReconnectPolicy.enabled
+        && (mReconnectPolicy.maxAttempts == 0 || mNumAttempts < mReconnectPolicy.maxAttempts);
+    // failed attempts while reconnecting do not get reported
+    if (wasConnected || !willReconnect) {
+        mSclangConnectionChangeCallback(false, mEpoch, willReconnect);
+    }
+    if (!willReconnect) {
+        mStatsTimer.stop();
+        mScheduledSends.cancel();
+        return;
+    }
+    auto delay = std::chrono::duration<double, std::milli>(mReconnectPolicy.initialDelay)
+        * std::pow(mReconnectPolicy.multiplier, mNumAttempts);
+    // the factor overflows to infinity after enough attempts, and a zero initial delay then gives NaN
+    if (!(delay < mReconnectPolicy.maxDelay)) {
+        delay = mReconnectPolicy.maxDelay;
+    }
+    delay *= 1.0 - std::clamp(mReconnectPolicy.jitter, 0.0, 1.0) * std::uniform_real_distribution<double>()(mRandom);
+    mNumAttempts++;
+
+    auto delayMs = std::chrono::duration_cast<std::chrono::milliseconds>(delay);
+    trace(TraceEvent::clientReconnectScheduled, mHandle, delayMs.count());
+    mConnecting = true;
+    mReconnectTimer.expires_after(delayMs);
+    mReconnectTimer.async_wait([self = shared_from_this()](beast::error_code) { self->startConnect(); });
 }
 
 void WebSocketClient::doRead() {
-    mWs.async_read(mBuffer, beast::bind_front_handler(&WebSocketClient::onRead, shared_from_this()));
+    mWs.async_read(
+        mBuffer, bindHandlerMemory(mReadMemory, beast::bind_front_handler(&WebSocketClient::onRead, shared_from_this()))
+    );
 }
 
 void WebSocketClient::onRead(beast::error_code ec, std::size_t bytesTransferred) {
     if (ec) {
         mConnected = false;
-        mSclangConnectionChangeCallback(false);
-        if (ec == boost::system::errc::operation_canceled || ec == boost::asio::error::eof) {
-            return;
+        mStats.setDisconnectReason(disconnectReasonFromError(ec));
+        mPingTimer.stop();
+        // deliver what has been received before the connection got closed
+        mBatcher.flush();
+        if (ec == boost::system::errc::operation_canceled || ec == boost::asio::error::eof
+            || ec == beast::websocket::error::closed) {
+            trace(TraceEvent::clientClosed, mHandle);
+        } else {
+            trace(TraceEvent::clientReadFailed, mHandle, ec);
         }
-        std::cout << "Failed to read websocket message: " << ec.message().c_str() << std::endl;
+        // aborts a pending write, so the stream can be reused for the next connection
+        beast::get_lowest_layer(mWs).close();
+        reconnectOrClose(true);
         return;
     };
 
-    auto message = convertData(mBuffer, bytesTransferred, mWs.got_text());
-    mSclangOnMessageCallback(message);
+    mStats.recordRead(bytesTransferred);
+    trace(TraceEvent::clientRead, mHandle, bytesTransferred);
+    auto message = viewData(mBuffer, bytesTransferred, mWs.got_text());
+    if (!message.isText && mSclangOscMessageCallback
+        && mOscParser.parse(message.data, message.size, mSclangOscMessageCallback)) {
+        // got delivered as decoded OSC
+    } else if (message.isText && mSclangJsonCallback
+               && mJsonDecoder.parse(reinterpret_cast<const char*>(message.data), message.size, mSclangJsonCallback)) {
+        // got delivered as decoded JSON
+    } else if (mBatcher.isEnabled()) {
+        mBatcher.push(message, shared_from_this());
+    } else {
+        mSclangOnMessageCallback(&message, 1);
+    }
+    // the view is invalid from here on
+    mBuffer.consume(bytesTransferred);
 
     doRead();
 }
 
 void WebSocketClient::doWrite() {
     if (!mConnected) {
-        std::cout << "WebSocket client is not connected - can not send out message" << std::endl;
+        if (mReconnectPolicy.enabled && !mClosed) {
+            // gets sent once the client has reconnected
+            if (mReconnectPolicy.maxHeldMessages > 0) {
+                mOutQueue.trim(mReconnectPolicy.maxHeldMessages);
+            }
+        } else if (!mOutQueue.empty()) {
+            trace(TraceEvent::clientNotConnected, mHandle);
+        }
         return;
     }
     if (!mIsWriting && !mOutQueue.empty()) {
         mIsWriting = true;
-        auto message = mOutQueue.front();
+        mWritingMessage = mOutQueue.pop();
 
-        mWs.text(std::holds_alternative<std::string>(message));
-        mWs.async_write(boost::asio::buffer(WebSocketSession::toAsioBuffer(message)),
-                        beast::bind_front_handler(&WebSocketClient::onWrite, shared_from_this()));
+        mWs.text(mWritingMessage.isText());
+        mWriteStartedAt = std::chrono::steady_clock::now();
+        mWs.async_write(
+            mWritingMessage.buffer(),
+            bindHandlerMemory(mWriteMemory, beast::bind_front_handler(&WebSocketClient::onWrite, shared_from_this()))
+        );
     }
 }
 
 void WebSocketClient::onWrite(beast::error_code ec, std::size_t bytesTransferred) {
     mIsWriting = false;
     if (ec) {
-        std::cout << "Failed to write websocket message: " << ec.message().c_str() << std::endl;
+        trace(TraceEvent::clientWriteFailed, mHandle, ec);
+    } else {
+        mStats.recordWrite(bytesTransferred, std::chrono::steady_clock::now() - mWriteStartedAt);
+        trace(TraceEvent::clientWrite, mHandle, bytesTransferred);
+    }
+    mWritingMessage = WebSocketPayload();
+    if (mConnectDeferred) {
+        resumeDeferredConnect();
+        return;
     }
-    mOutQueue.pop();
     doWrite();
 }
@@ -1,60 +1,198 @@
 #pragma once
 
 #include <queue>
+#include <random>
 #include <thread>
 
 #include <boost/beast/core.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/strand.hpp>
 
 #include "ws_common.h"
+#include "ws_json.h"
+#include "ws_memory.h"
+#include "ws_mpsc.h"
+#include "ws_osc.h"
+#include "ws_stream.h"
 #include "boost/beast/websocket/stream.hpp"
 
 namespace beast = boost::beast;
 using tcp = boost::asio::ip::tcp;
 
-using ConnectionChangeCallback = std::function<void(bool)>;
-using MessageCallback = std::function<void(WebSocketData&)>;
+// the epoch counts the established connections of a client, starting at 1. If the connection
+// dropped, willReconnect tells whether the client tries to connect again or has been closed for good
+using ConnectionChangeCallback = std::function<void(bool isConnected, uint32_t epoch, bool willReconnect)>;
+using QueueStateCallback = std::function<void(bool isAboveHighWatermark)>;
+// gets called with a single message, or with multiple messages if batching is enabled
+using MessageCallback = std::function<void(const WebSocketDataView* messages, size_t numMessages)>;
+
+// how a client connects again after a connection attempt failed or its connection dropped
+struct ReconnectPolicy {
+    bool enabled = false;
+    // the delay before the first attempt, every further attempt multiplies it up to the max delay
+    std::chrono::milliseconds initialDelay { 10 };
+    std::chrono::milliseconds maxDelay { 5000 };
+    double multiplier = 2.0;
+    // the fraction of a delay which gets randomized, so clients do not reconnect in lockstep
+    double jitter = 0.5;
+    // consecutive failed attempts until the client gives up, 0 retries forever
+    uint32_t maxAttempts = 0;
+    // messages which get held while disconnected, the oldest get dropped. 0 holds all of them
+    size_t maxHeldMessages = 1024;
+};
 
 // the client consumes from an external websocket server
 // see https://www.boost.org/doc/libs/latest/libs/beast/example/websocket/client/async/websocket_client_async.cpp
 class WebSocketClient : public std::enable_shared_from_this<WebSocketClient> {
     std::string mHost;
     int mPort;
+    // the path of the unix domain socket if the host is of the form `unix:/path`, see `localSocketPath`
+    std::string mLocalPath;
 
     boost::asio::io_context& mIoContext;  // @todo maybe do not store this here?
+    // all async operations of the client run on this strand, so the client can be used with multiple io threads
+    boost::asio::strand<boost::asio::io_context::executor_type> mStrand;
     boost::asio::ip::tcp::resolver mResolver;
-    beast::websocket::stream<beast::tcp_stream> mWs;
+    // the endpoints of the last successful resolve, so a reconnect does not need to resolve again
+    boost::asio::ip::tcp::resolver::results_type mEndpoints;
+    beast::websocket::stream<CountingStream<TransportSocket>> mWs;
     beast::flat_buffer mBuffer;
+    MessageBatcher mBatcher;
+    OscParser mOscParser;
+    JsonDecoder mJsonDecoder;
     bool mConnected = false;
+    // from starting to connect or waiting for a reconnect until the handshake completed or failed
+    bool mConnecting = false;
+    // a connect waits until no write or ping of the previous connection is pending, the stream gets reused
+    bool mConnectDeferred = false;
+    // set by `closeConnection`, a closed client does not reconnect
+    bool mClosed = false;
     bool mIsWriting = false;
-    std::queue<WebSocketData> mOutQueue;
+    ReconnectPolicy mReconnectPolicy;
+    boost::asio::steady_timer mReconnectTimer;
+    // consecutive failed attempts
+    uint32_t mNumAttempts = 0;
+    uint32_t mEpoch = 0;
+    std::minstd_rand mRandom;
+    OutboundQueue mOutQueue;
+    // messages which wait for the time they should be sent at, kept while reconnecting
+    SendScheduler mScheduledSends;
+    // messages which have been sent from other threads and wait for the strand
+    SubmissionQueue<WebSocketPayload> mSubmissions;
+    // recycled by the operations of the read, write and submission loops
+    HandlerMemory mReadMemory;
+    HandlerMemory mWriteMemory;
+    HandlerMemory mSubmitMemory;
+    ConnectionStats mStats;
+    PeriodicTimer mStatsTimer;
+    KeepAliveOptions mKeepAlive;
+    PeriodicTimer mPingTimer;
+    // only a single ping gets written at a time
+    bool mPingPending = false;
+    std::chrono::steady_clock::time_point mWriteStartedAt;
+    // the message which is currently written, kept alive until the write has completed
+    WebSocketPayload mWritingMessage;
+    // identifier for sclang side, see `HandleTable`
+    int32_t mHandle = -1;
 
 public:
+    // a host of the form `unix:/path` connects to the unix domain socket at that path, the port gets ignored
     explicit WebSocketClient(boost::asio::io_context&, std::string host, int port);
 
     void connect();
 
-    beast::error_code closeConnection();
+    void closeConnection();
+
+    void setReconnectPolicy(const ReconnectPolicy& policy);
+
+    // applies to connections which get established afterwards
+    void setKeepAlive(const KeepAliveOptions& keepAlive);
+
+    // see `MessageBatcher::configure`
+    void setMessageBatching(size_t maxMessages, size_t maxBytes, std::chrono::microseconds maxLatency);
+
+    void setQueueLimits(const QueueLimits& limits);
+
+    // see `JsonDecoder::setPointers`
+    void setJsonPointers(std::vector<std::string> pointers);
+
+    // can be called from any thread - returns false if the send queue would reject the message
+    bool acceptsMessage(size_t numBytes) const { return mOutQueue.accepts(numBytes); }
+
+    // needs to be set before connecting
+    void setCompression(const beast::websocket::permessage_deflate& compression);
+
+    // can be called from any thread
+    CompressionStats getCompressionStats() const;
+
+    // can be called from any thread - a snapshot of the counters as a JSON object
+    std::string getStatsJson() const;
+
+    // pushes a snapshot of the stats every interval, an interval of 0 stops pushing
+    void setStatsInterval(std::chrono::milliseconds interval, StatsCallback callback);
+
+    // needs to be set before connecting
+    void setHandle(int32_t handle) { mHandle = handle; }
 
-    // send a message to the server via a queue
-    void enqueueMessage(WebSocketData& message);
+    int32_t getHandle() const { return mHandle; }
+
+    // send a message to the server via a queue, see `WebSocketSession::enqueueMessage`
+    bool enqueueMessage(WebSocketPayload message);
+
+    // replaces a message with the same key which has not been sent yet
+    void enqueueKeyedMessage(std::string key, WebSocketPayload message);
+
+    // enqueues all messages at once, so they get written back to back
+    void enqueueMessages(std::vector<WebSocketPayload> messages);
+
+    // enqueues the message once the time has come, see `SendScheduler`
+    void enqueueMessageAt(std::chrono::steady_clock::time_point time, WebSocketPayload message);
+
+    // runs the function on the strand of the client, so e.g. a callback
+    // does not get replaced while the client invokes it
+    void runOnStrand(std::function<void()> function);
 
     // sclang callbacks - pay attention...
     ConnectionChangeCallback mSclangConnectionChangeCallback;
     MessageCallback mSclangOnMessageCallback;
+    QueueStateCallback mSclangQueueStateCallback;
+    // if set, binary messages which are valid OSC get decoded and passed here instead
+    OscParser::MessageCallback mSclangOscMessageCallback;
+    // if set, text messages which are valid JSON get decoded and passed here instead
+    JsonDecoder::FieldCallback mSclangJsonCallback;
 
 private:
+    void startConnect();
+
     void onResolve(beast::error_code ec, boost::asio::ip::tcp::resolver::results_type results);
 
     void onConnect(beast::error_code ec, boost::asio::ip::tcp::resolver::results_type::endpoint_type endpoint);
 
+    // continues with the websocket handshake once the socket got connected, host is the value of the Host header
+    void onSocketConnect(beast::error_code ec, const std::string& host);
+
     void onHandshake(beast::error_code ec);
 
+    void sendPing();
+
+    // starts a connect which waited for the write and ping of the previous connection to complete
+    void resumeDeferredConnect();
+
+    // schedules the next attempt after a failed attempt or a dropped connection,
+    // or reports the client as closed if it does not reconnect
+    void reconnectOrClose(bool wasConnected);
+
     void doRead();
 
     void onRead(beast::error_code ec, std::size_t bytesTransferred);
 
-    void onClose() { mConnected = false; }
+    void onClose(beast::error_code ec);
+
+    // runs the function on the strand after the pending submissions, so the order of sends is kept
+    template <class Function>
+    void dispatchOrdered(Function&& function);
+
+    void drainSubmissions();
 
     void doWrite();
 
@@ -1,27 +1,425 @@
 #include "ws_common.h"
+#include "ws_memory.h"
 
-#include <iostream>
+#include <algorithm>
+#include <charconv>
 
-WebSocketData convertData(boost::beast::flat_buffer& buffer, size_t bytesTransferred, bool isText) {
-    WebSocketData data;
-    if (isText) {
-        data = boost::beast::buffers_to_string(buffer.data());
-    } else {
-        auto array_data = std::vector<uint8_t>(bytesTransferred);
-        std::memcpy(array_data.data(), buffer.data().data(), bytesTransferred);
-        data = array_data;
+
+WebSocketPayload WebSocketPayload::copyFrom(const void* data, size_t size, bool isText) {
+    uint8_t sizeClass;
+    auto memory = BufferPool::instance().allocate(sizeof(Block) + size, sizeClass);
+    auto block = new (memory) Block{
+        .refCount = { 1 },
+        .isText = isText,
+        .sizeClass = sizeClass,
+        .size = size,
+    };
+    if (size > 0) {
+        std::memcpy(reinterpret_cast<uint8_t*>(block + 1), data, size);
+    }
+    return WebSocketPayload(block);
+}
+
+WebSocketPayload::WebSocketPayload(WebSocketPayload&& other) noexcept: mBlock(other.mBlock) { other.mBlock = nullptr; }
+
+WebSocketPayload& WebSocketPayload::operator=(WebSocketPayload&& other) noexcept {
+    if (this != &other) {
+        release();
+        mBlock = other.mBlock;
+        other.mBlock = nullptr;
+    }
+    return *this;
+}
+
+WebSocketPayload::~WebSocketPayload() { release(); }
+
+WebSocketPayload WebSocketPayload::share() const {
+    if (mBlock) {
+        mBlock->refCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    return WebSocketPayload(mBlock);
+}
+
+void WebSocketPayload::release() {
+    if (mBlock && mBlock->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        auto sizeClass = mBlock->sizeClass;
+        mBlock->~Block();
+        BufferPool::instance().deallocate(mBlock, sizeClass);
+    }
+    mBlock = nullptr;
+}
+
+bool unpackBatch(const uint8_t* data, size_t size, std::vector<WebSocketPayload>& outMessages) {
+    constexpr size_t headerSize = 5;
+    // validate the whole batch first, so a malformed batch does not allocate any payload
+    size_t numMessages = 0;
+    for (size_t offset = 0; offset < size; numMessages++) {
+        if (size - offset < headerSize) {
+            return false;
+        }
+        uint32_t length = (uint32_t(data[offset + 1]) << 24) | (uint32_t(data[offset + 2]) << 16)
+            | (uint32_t(data[offset + 3]) << 8) | uint32_t(data[offset + 4]);
+        if (size - offset - headerSize < length) {
+            return false;
+        }
+        offset += headerSize + length;
+    }
+
+    outMessages.reserve(outMessages.size() + numMessages);
+    for (size_t offset = 0; offset < size;) {
+        bool isText = data[offset] != 0;
+        uint32_t length = (uint32_t(data[offset + 1]) << 24) | (uint32_t(data[offset + 2]) << 16)
+            | (uint32_t(data[offset + 3]) << 8) | uint32_t(data[offset + 4]);
+        outMessages.push_back(WebSocketPayload::copyFrom(data + offset + headerSize, length, isText));
+        offset += headerSize + length;
+    }
+    return true;
+}
+
+WebSocketDataView viewData(boost::beast::flat_buffer& buffer, size_t bytesTransferred, bool isText) {
+    // a flat_buffer is always a single contiguous block of memory
+    return WebSocketDataView{
+        .data = static_cast<uint8_t*>(buffer.data().data()),
+        .size = bytesTransferred,
+        .isText = isText,
+        .receivedAt = std::chrono::steady_clock::now(),
+    };
+}
+
+MessageBatcher::MessageBatcher(const boost::asio::any_io_executor& executor, FlushCallback callback):
+    mCallback(std::move(callback)),
+    mTimer(executor)
+{}
+
+void MessageBatcher::configure(size_t maxMessages, size_t maxBytes, std::chrono::microseconds maxLatency) {
+    flush();
+    mMaxMessages = maxMessages;
+    mMaxBytes = maxBytes;
+    mMaxLatency = maxLatency;
+}
+
+void MessageBatcher::push(const WebSocketDataView& message, std::shared_ptr<void> keepAlive) {
+    if (mEntries.empty()) {
+        mTimer.expires_after(mMaxLatency);
+        mTimer.async_wait([this, keepAlive = std::move(keepAlive), batchId = mBatchId](boost::system::error_code ec) {
+            if (!ec && batchId == mBatchId) {
+                flush();
+            }
+        });
+    }
+    mEntries.push_back(Entry{
+        .offset = mData.size(),
+        .size = message.size,
+        .isText = message.isText,
+        .receivedAt = message.receivedAt,
+    });
+    mData.insert(mData.end(), message.data, message.data + message.size);
+
+    if (mEntries.size() >= mMaxMessages || (mMaxBytes > 0 && mData.size() >= mMaxBytes)) {
+        flush();
     }
-    buffer.consume(bytesTransferred);
-    return data;
+}
+
+void MessageBatcher::flush() {
+    if (mEntries.empty()) {
+        return;
+    }
+    mBatchId++;
+    mTimer.cancel();
+
+    // the views can only be created now as the data buffer may have been reallocated while pushing
+    mViews.clear();
+    for (const auto& entry : mEntries) {
+        mViews.push_back(WebSocketDataView{
+            .data = mData.data() + entry.offset,
+            .size = entry.size,
+            .isText = entry.isText,
+            .receivedAt = entry.receivedAt,
+        });
+    }
+    if (mCallback) {
+        mCallback(mViews.data(), mViews.size());
+    }
+    mEntries.clear();
+    mData.clear();
+}
+
+OutboundQueue::OutboundQueue(const boost::asio::any_io_executor& executor, WatermarkCallback watermarkCallback,
+                             DisconnectCallback disconnectCallback):
+    mWatermarkCallback(std::move(watermarkCallback)),
+    mDisconnectCallback(std::move(disconnectCallback)),
+    mDisconnectTimer(executor)
+{}
+
+void OutboundQueue::configure(const QueueLimits& limits) {
+    mLimits = limits;
+    mMaxMessages = limits.maxMessages;
+    mMaxBytes = limits.maxBytes;
+    mRejects = limits.policy == QueuePolicy::reject;
+    mDropsOnOverflow = (limits.maxMessages > 0 || limits.maxBytes > 0)
+        && (limits.policy == QueuePolicy::reject || limits.policy == QueuePolicy::dropNewest);
+    if (mDisconnectPending && limits.policy != QueuePolicy::disconnect) {
+        mDisconnectPending = false;
+        mDisconnectTimer.cancel();
+    }
+}
+
+bool OutboundQueue::accepts(size_t numBytes) const {
+    if (!mRejects.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    auto maxMessages = mMaxMessages.load(std::memory_order_relaxed);
+    auto maxBytes = mMaxBytes.load(std::memory_order_relaxed);
+    return !((maxMessages > 0 && mNumMessages.load(std::memory_order_relaxed) >= maxMessages)
+             || (maxBytes > 0 && mNumBytes.load(std::memory_order_relaxed) + numBytes > maxBytes));
+}
+
+QueueStats OutboundQueue::getStats() const {
+    return QueueStats{
+        .numMessages = mNumMessages.load(std::memory_order_relaxed),
+        .numBytes = mNumBytes.load(std::memory_order_relaxed),
+        .peakNumMessages = mPeakNumMessages.load(std::memory_order_relaxed),
+        .numDropped = mNumDropped.load(std::memory_order_relaxed),
+    };
+}
+
+bool OutboundQueue::isFull(size_t numBytes) const {
+    return (mLimits.maxMessages > 0 && mQueue.size() >= mLimits.maxMessages)
+        || (mLimits.maxBytes > 0 && mNumBytes + numBytes > mLimits.maxBytes);
+}
+
+bool OutboundQueue::push(WebSocketPayload message, const std::shared_ptr<void>& keepAlive, std::string key) {
+    if (!key.empty()) {
+        if (auto it = mKeyedEntries.find(key); it != mKeyedEntries.end()) {
+            // replacing keeps the position in the queue and does not count against the message limit,
+            // but a larger message must not push the queue beyond its byte limit
+            auto& entry = mQueue[it->second - mFrontSequence];
+            if (message.size() > entry.message.size()
+                && mLimits.maxBytes > 0 && mNumBytes + (message.size() - entry.message.size()) > mLimits.maxBytes) {
+                mNumDropped++;
+                return false;
+            }
+            mNumBytes = mNumBytes - entry.message.size() + message.size();
+            entry.message = std::move(message);
+            checkHighWatermark();
+            onRemoved();
+            return true;
+        }
+    }
+
+    if (isFull(message.size())) {
+        switch (mLimits.policy) {
+        case QueuePolicy::dropOldest:
+            while (!mQueue.empty() && isFull(message.size())) {
+                pop();
+                mNumDropped++;
+            }
+            break;
+        case QueuePolicy::disconnect:
+            if (!mDisconnectPending) {
+                mDisconnectPending = true;
+                mDisconnectTimer.expires_after(mLimits.disconnectTimeout);
+                mDisconnectTimer.async_wait([this, keepAlive](boost::system::error_code ec) {
+                    if (ec || !mDisconnectPending) {
+                        return;
+                    }
+                    mDisconnectPending = false;
+                    if (mNumBytes > mLimits.lowWatermark && mDisconnectCallback) {
+                        mDisconnectCallback();
+                    }
+                });
+            }
+            break;
+        case QueuePolicy::reject:
+        case QueuePolicy::dropNewest:
+            break;
+        }
+        // a single message may exceed the limits even on an empty queue
+        if (isFull(message.size())) {
+            mNumDropped++;
+            return false;
+        }
+    }
+
+    mNumBytes += message.size();
+    if (!key.empty()) {
+        mKeyedEntries.emplace(key, mFrontSequence + mQueue.size());
+    }
+    mQueue.push_back(Entry{ std::move(message), std::move(key) });
+    mNumMessages = mQueue.size();
+    if (mQueue.size() > mPeakNumMessages.load(std::memory_order_relaxed)) {
+        mPeakNumMessages.store(mQueue.size(), std::memory_order_relaxed);
+    }
+
+    checkHighWatermark();
+    return true;
+}
+
+WebSocketPayload OutboundQueue::pop() {
+    auto& entry = mQueue.front();
+    if (!entry.key.empty()) {
+        mKeyedEntries.erase(entry.key);
+    }
+    auto message = std::move(entry.message);
+    mQueue.pop_front();
+    mFrontSequence++;
+    mNumBytes -= message.size();
+    mNumMessages = mQueue.size();
+    onRemoved();
+    return message;
+}
+
+boost::beast::websocket::stream_base::timeout keepAliveTimeout(const KeepAliveOptions& options,
+                                                               boost::beast::role_type role) {
+    auto timeout = boost::beast::websocket::stream_base::timeout::suggested(role);
+    if (options.idleTimeout.count() > 0) {
+        timeout.idle_timeout = options.idleTimeout;
+        // otherwise beast times out if no message got read within the timeout, even if pongs have been received
+        timeout.keep_alive_pings = true;
+    }
+    return timeout;
+}
+
+namespace {
+constexpr std::string_view kPingPrefix = "rtt:";
+}
+
+boost::beast::websocket::ping_data makePingPayload() {
+    auto sentAt = std::chrono::steady_clock::now().time_since_epoch();
+    auto payload = std::string(kPingPrefix) + std::to_string(sentAt.count());
+    return boost::beast::websocket::ping_data(payload.data(), payload.size());
+}
+
+void recordPong(RttWindow& rtt, boost::beast::string_view payload) {
+    if (payload.substr(0, kPingPrefix.size()) != kPingPrefix) {
+        return;
+    }
+    std::chrono::steady_clock::rep sentAt;
+    auto digits = payload.substr(kPingPrefix.size());
+    auto result = std::from_chars(digits.data(), digits.data() + digits.size(), sentAt);
+    if (result.ec != std::errc() || result.ptr != digits.data() + digits.size()) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    rtt.record(now - std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(sentAt)));
+}
+
+void OutboundQueue::trim(size_t maxMessages) {
+    while (mQueue.size() > maxMessages) {
+        pop();
+        mNumDropped++;
+    }
+}
+
+void OutboundQueue::checkHighWatermark() {
+    if (mLimits.highWatermark > 0 && !mIsAboveHighWatermark && mNumBytes >= mLimits.highWatermark) {
+        mIsAboveHighWatermark = true;
+        if (mWatermarkCallback) {
+            mWatermarkCallback(true);
+        }
+    }
+}
+
+void OutboundQueue::onRemoved() {
+    if (mNumBytes <= mLimits.lowWatermark) {
+        if (mDisconnectPending) {
+            mDisconnectPending = false;
+            mDisconnectTimer.cancel();
+        }
+        if (mIsAboveHighWatermark) {
+            mIsAboveHighWatermark = false;
+            if (mWatermarkCallback) {
+                mWatermarkCallback(false);
+            }
+        }
+    }
+}
+
+SendScheduler::SendScheduler(const boost::asio::any_io_executor& executor, DueCallback dueCallback):
+    mDueCallback(std::move(dueCallback)),
+    mTimer(executor)
+{}
+
+void SendScheduler::schedule(std::chrono::steady_clock::time_point time, WebSocketPayload message,
+                             const std::shared_ptr<void>& keepAlive) {
+    auto isEarliest = mEntries.empty() || time < mEntries.front().time;
+    mEntries.push_back(Entry{
+        .time = time,
+        .sequence = mNextSequence++,
+        .message = std::move(message),
+    });
+    std::push_heap(mEntries.begin(), mEntries.end(), isLater);
+    if (isEarliest) {
+        arm(keepAlive);
+    }
+}
+
+void SendScheduler::cancel() {
+    mEntries.clear();
+    mTimer.cancel();
+}
+
+void SendScheduler::arm(const std::shared_ptr<void>& keepAlive) {
+    // replaces the wait for a later entry, whose handler gets aborted
+    mTimer.expires_at(mEntries.front().time);
+    mTimer.async_wait([this, keepAlive](boost::system::error_code ec) {
+        if (!ec) {
+            sendDue(keepAlive);
+        }
+    });
+}
+
+void SendScheduler::sendDue(const std::shared_ptr<void>& keepAlive) {
+    auto now = std::chrono::steady_clock::now();
+    while (!mEntries.empty() && mEntries.front().time <= now) {
+        std::pop_heap(mEntries.begin(), mEntries.end(), isLater);
+        auto message = std::move(mEntries.back().message);
+        mEntries.pop_back();
+        mDueCallback(std::move(message));
+    }
+    if (!mEntries.empty()) {
+        arm(keepAlive);
+    }
+}
+
+PeriodicTimer::PeriodicTimer(const boost::asio::any_io_executor& executor): mTimer(executor) {}
+
+void PeriodicTimer::start(std::chrono::milliseconds interval, Callback callback, std::shared_ptr<void> keepAlive) {
+    stop();
+    if (interval.count() <= 0) {
+        return;
+    }
+    mInterval = interval;
+    mCallback = std::move(callback);
+    schedule(std::move(keepAlive));
+}
+
+void PeriodicTimer::stop() {
+    mGeneration++;
+    mCallback = nullptr;
+    mTimer.cancel();
+}
+
+void PeriodicTimer::schedule(std::shared_ptr<void> keepAlive) {
+    mTimer.expires_after(mInterval);
+    mTimer.async_wait([this, keepAlive = std::move(keepAlive), generation = mGeneration](boost::system::error_code ec) {
+        if (ec || generation != mGeneration) {
+            return;
+        }
+        // the callback may replace itself, so do not invoke the member directly
+        auto callback = mCallback;
+        callback();
+        // the callback may have stopped the timer
+        if (generation == mGeneration) {
+            schedule(keepAlive);
+        }
+    });
 }
 
 boost::asio::io_context& WebSocketThread::getContext() { return mIoContext; }
 
 void WebSocketThread::start() {
     if (!mThread) {
-#ifdef SC_WEBSOCKET_DEBUG
-        std::cout << "Start websocket thread" << std::endl;
-#endif
         mThread = std::make_shared<std::thread>([this]() {
             auto work = boost::asio::make_work_guard(mIoContext);
             mIoContext.run();
@@ -38,7 +436,6 @@ void WebSocketThread::stop() {
 }
 
 WebSocketThread::~WebSocketThread() {
-    std::cout << "Clean websocket thread" << std::endl;
     stop();
 }
 
@@ -1,15 +1,379 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/beast.hpp>
 
-// a websocket message can either be a byte array or a string
-// see https://developer.mozilla.org/en-US/docs/Web/API/WebSocket/message_event
-using WebSocketData = std::variant<std::vector<uint8_t>, std::string>;
+#include "ws_stats.h"
 
-// converts a raw beast buffer into a consumable data object
-WebSocketData convertData(boost::beast::flat_buffer& buffer, size_t bytesTransferred, bool isText);
+/** An immutable, reference counted outbound websocket message.
+A message can either be a byte array or a string,
+see https://developer.mozilla.org/en-US/docs/Web/API/WebSocket/message_event
+The data gets copied exactly once into a single allocation from the `BufferPool` upon creation.
+Afterwards the payload is moved through the send queue until the write has completed.
+Copying is disabled to avoid accidental copies - use `share` if the same data
+should be sent via multiple connections.
+*/
+class WebSocketPayload {
+public:
+    WebSocketPayload() = default;
+
+    static WebSocketPayload copyFrom(const void* data, size_t size, bool isText);
+
+    WebSocketPayload(const WebSocketPayload&) = delete;
+    WebSocketPayload& operator=(const WebSocketPayload&) = delete;
+    WebSocketPayload(WebSocketPayload&& other) noexcept;
+    WebSocketPayload& operator=(WebSocketPayload&& other) noexcept;
+
+    ~WebSocketPayload();
+
+    // returns a new reference to the same data
+    WebSocketPayload share() const;
+
+    bool isText() const { return mBlock && mBlock->isText; }
+
+    size_t size() const { return mBlock ? mBlock->size : 0; }
+
+    const uint8_t* data() const { return mBlock ? reinterpret_cast<const uint8_t*>(mBlock + 1) : nullptr; }
+
+    boost::asio::const_buffer buffer() const { return { data(), size() }; }
+
+    explicit operator bool() const { return mBlock != nullptr; }
+
+private:
+    // header of the allocation, the message data follows directly after it
+    struct Block {
+        std::atomic<uint32_t> refCount;
+        bool isText;
+        // see `BufferPool`
+        uint8_t sizeClass;
+        size_t size;
+    };
+
+    explicit WebSocketPayload(Block* block): mBlock(block) {}
+
+    void release();
+
+    Block* mBlock = nullptr;
+};
+
+// a non-owning view of a received message which points directly into the read buffer
+// of a connection. It is only valid during the message callback - the buffer gets
+// consumed and reused for the next message afterwards.
+struct WebSocketDataView {
+    uint8_t* data;
+    size_t size;
+    bool isText;
+    // when the read of the message completed, so the time spent in batches and callbacks can be measured
+    std::chrono::steady_clock::time_point receivedAt;
+};
+
+/** Splits a packed batch of messages into payloads.
+The layout of each message within the batch is
+- 1 byte kind, 1 for a text message and 0 for a binary message
+- 4 bytes length of the message data as big endian
+- the message data
+Returns false if the batch is malformed, in which case no payload gets created.
+*/
+bool unpackBatch(const uint8_t* data, size_t size, std::vector<WebSocketPayload>& outMessages);
+
+// creates a view of a raw beast buffer without copying it, stamped with the current time
+WebSocketDataView viewData(boost::beast::flat_buffer& buffer, size_t bytesTransferred, bool isText);
+
+/** Collects received messages of a connection and delivers them as one batch.
+Calling into sclang has a fixed cost per call, so on high message rates it is
+cheaper to deliver multiple messages at once. A batch gets flushed as soon as it
+holds `maxMessages` messages or `maxBytes` bytes, or when its oldest message is
+older than `maxLatency`. The messages get copied into an internal buffer which
+keeps its capacity between batches.
+All methods need to be called from the strand of the connection.
+*/
+class MessageBatcher {
+public:
+    using FlushCallback = std::function<void(const WebSocketDataView* messages, size_t numMessages)>;
+
+    MessageBatcher(const boost::asio::any_io_executor& executor, FlushCallback callback);
+
+    // a maxMessages of 0 or 1 disables batching, pending messages get flushed
+    void configure(size_t maxMessages, size_t maxBytes, std::chrono::microseconds maxLatency);
+
+    bool isEnabled() const { return mMaxMessages > 1; }
+
+    // keepAlive gets held by the latency timer, so the owner of the batcher outlives the timer
+    void push(const WebSocketDataView& message, std::shared_ptr<void> keepAlive);
+
+    void flush();
+
+private:
+    struct Entry {
+        size_t offset;
+        size_t size;
+        bool isText;
+        std::chrono::steady_clock::time_point receivedAt;
+    };
+
+    FlushCallback mCallback;
+    boost::asio::steady_timer mTimer;
+    size_t mMaxMessages = 0;
+    size_t mMaxBytes = 0;
+    std::chrono::microseconds mMaxLatency { 0 };
+    // identifies the current batch, so a late timer does not flush a newer batch
+    uint64_t mBatchId = 0;
+    std::vector<uint8_t> mData;
+    std::vector<Entry> mEntries;
+    std::vector<WebSocketDataView> mViews;
+};
+
+// what happens to messages which get sent while the send queue of a connection is full
+enum class QueuePolicy : int {
+    // the message gets dropped and the sender gets notified
+    reject = 0,
+    // the oldest queued messages get dropped to make room for the new message
+    dropOldest = 1,
+    // the message gets dropped silently
+    dropNewest = 2,
+    // the message gets dropped and the connection gets closed if the queue
+    // does not drain below its low watermark within the disconnect timeout
+    disconnect = 3,
+};
+
+struct QueueLimits {
+    // a limit of 0 means unlimited
+    size_t maxMessages = 0;
+    size_t maxBytes = 0;
+    QueuePolicy policy = QueuePolicy::reject;
+    // number of queued bytes - a high watermark of 0 disables the watermark callback
+    size_t highWatermark = 0;
+    size_t lowWatermark = 0;
+    std::chrono::milliseconds disconnectTimeout { 0 };
+};
+
+struct KeepAliveOptions {
+    // a ping gets sent every interval to measure the round trip time, 0 disables pings
+    std::chrono::milliseconds pingInterval { 0 };
+    // the connection gets closed if nothing has been received within this time,
+    // 0 keeps the suggested timeout of beast for the role
+    std::chrono::milliseconds idleTimeout { 0 };
+};
+
+boost::beast::websocket::stream_base::timeout keepAliveTimeout(const KeepAliveOptions& options,
+                                                               boost::beast::role_type role);
+
+// true if the calling thread runs the io_context of the executor, e.g. within a completion handler
+inline bool runsOnIoThread(const boost::asio::any_io_executor& executor) {
+    auto& context = boost::asio::query(executor, boost::asio::execution::context);
+    return static_cast<boost::asio::io_context&>(context).get_executor().running_in_this_thread();
+}
+
+// the payload of a ping carries its send time, so the round trip time can be measured from the pong
+boost::beast::websocket::ping_data makePingPayload();
+
+// records the round trip time of a pong to a ping of `makePingPayload`, other pongs get ignored
+void recordPong(RttWindow& rtt, boost::beast::string_view payload);
+
+/** A queue on a ring of slots which only grows.
+Unlike std::deque it does not allocate and free blocks while elements pass
+through, so a queue which stays below its peak size does not allocate.
+*/
+template <class T>
+class GrowingRing {
+public:
+    bool empty() const { return mSize == 0; }
+
+    size_t size() const { return mSize; }
+
+    T& front() { return mSlots[mFront]; }
+
+    T& operator[](size_t index) { return mSlots[(mFront + index) & (mSlots.size() - 1)]; }
+
+    void push_back(T value) {
+        if (mSize == mSlots.size()) {
+            grow();
+        }
+        mSlots[(mFront + mSize) & (mSlots.size() - 1)] = std::move(value);
+        mSize++;
+    }
+
+    void pop_front() {
+        // releases what the element holds, but keeps the slot
+        mSlots[mFront] = T();
+        mFront = (mFront + 1) & (mSlots.size() - 1);
+        mSize--;
+    }
+
+private:
+    // the number of slots stays a power of two
+    void grow() {
+        std::vector<T> slots(std::max<size_t>(16, mSlots.size() * 2));
+        for (size_t i = 0; i < mSize; i++) {
+            slots[i] = std::move((*this)[i]);
+        }
+        mSlots = std::move(slots);
+        mFront = 0;
+    }
+
+    std::vector<T> mSlots;
+    size_t mFront = 0;
+    size_t mSize = 0;
+};
+
+/** The send queue of a connection with optional limits.
+By default the queue is unbounded. If limits are set, the queue applies its
+policy on overflow and reports crossing its high and low watermark, so
+a sender can throttle itself before the queue is full.
+Messages can be pushed with a key, in which case a message with the same key
+which is still waiting in the queue gets replaced in place. This conflates
+e.g. parameter updates so a slow peer only receives the latest value per key.
+All methods except `accepts` need to be called from the strand of the connection.
+*/
+class OutboundQueue {
+public:
+    using WatermarkCallback = std::function<void(bool isAboveHighWatermark)>;
+    using DisconnectCallback = std::function<void()>;
+
+    OutboundQueue(const boost::asio::any_io_executor& executor, WatermarkCallback watermarkCallback,
+                  DisconnectCallback disconnectCallback);
+
+    void configure(const QueueLimits& limits);
+
+    // can be called from any thread - returns false if a message of this size would be rejected
+    bool accepts(size_t numBytes) const;
+
+    // can be called from any thread - true if the limits are set and the policy drops new messages
+    bool dropsOnOverflow() const { return mDropsOnOverflow.load(std::memory_order_relaxed); }
+
+    // can be called from any thread - counts a message which got dropped before reaching the queue
+    void recordDropped() { mNumDropped.fetch_add(1, std::memory_order_relaxed); }
+
+    // returns false if the message got dropped. An empty key does not conflate.
+    // keepAlive gets held by the disconnect timer, so the owner of the queue outlives the timer
+    bool push(WebSocketPayload message, const std::shared_ptr<void>& keepAlive, std::string key = {});
+
+    WebSocketPayload pop();
+
+    // drops the oldest messages until at most maxMessages are queued
+    void trim(size_t maxMessages);
+
+    bool empty() const { return mQueue.empty(); }
+
+    // can be called from any thread
+    QueueStats getStats() const;
+
+private:
+    struct Entry {
+        WebSocketPayload message;
+        std::string key;
+    };
+
+    bool isFull(size_t numBytes) const;
+
+    void checkHighWatermark();
+
+    // checks the watermarks after the number of queued bytes decreased
+    void onRemoved();
+
+    WatermarkCallback mWatermarkCallback;
+    DisconnectCallback mDisconnectCallback;
+    boost::asio::steady_timer mDisconnectTimer;
+    bool mDisconnectPending = false;
+    bool mIsAboveHighWatermark = false;
+
+    QueueLimits mLimits;
+    // these are also read from the sclang thread in `accepts`
+    std::atomic<size_t> mMaxMessages = 0;
+    std::atomic<size_t> mMaxBytes = 0;
+    std::atomic<bool> mRejects = false;
+    std::atomic<bool> mDropsOnOverflow = false;
+    std::atomic<size_t> mNumMessages = 0;
+    std::atomic<size_t> mNumBytes = 0;
+    // these are only read for stats
+    std::atomic<size_t> mPeakNumMessages = 0;
+    std::atomic<size_t> mNumDropped = 0;
+
+    GrowingRing<Entry> mQueue;
+    // every entry gets a sequence number, so the index of an entry is its
+    // sequence number minus the sequence number of the front entry
+    uint64_t mFrontSequence = 0;
+    std::unordered_map<std::string, uint64_t> mKeyedEntries;
+};
+
+/** Holds messages until the time they should be sent at.
+The messages are kept in a heap ordered by their time, and a single timer waits for
+the earliest one, so scheduling ahead does not cost a timer per message. Once a message
+is due it gets passed to the due callback, which pushes it into the send queue.
+Messages with the same time keep the order in which they got scheduled.
+All methods need to be called from the strand of the connection.
+*/
+class SendScheduler {
+public:
+    using DueCallback = std::function<void(WebSocketPayload message)>;
+
+    SendScheduler(const boost::asio::any_io_executor& executor, DueCallback dueCallback);
+
+    // a time in the past sends the message right away.
+    // keepAlive gets held by the timer, so the owner of the scheduler outlives the timer
+    void schedule(std::chrono::steady_clock::time_point time, WebSocketPayload message,
+                  const std::shared_ptr<void>& keepAlive);
+
+    // drops all scheduled messages
+    void cancel();
+
+    size_t size() const { return mEntries.size(); }
+
+private:
+    struct Entry {
+        std::chrono::steady_clock::time_point time;
+        uint64_t sequence;
+        WebSocketPayload message;
+    };
+
+    // orders the heap so its front is the earliest entry
+    static bool isLater(const Entry& a, const Entry& b) {
+        return a.time != b.time ? a.time > b.time : a.sequence > b.sequence;
+    }
+
+    void arm(const std::shared_ptr<void>& keepAlive);
+
+    void sendDue(const std::shared_ptr<void>& keepAlive);
+
+    DueCallback mDueCallback;
+    boost::asio::steady_timer mTimer;
+    std::vector<Entry> mEntries;
+    uint64_t mNextSequence = 0;
+};
+
+/** Periodically calls a function, e.g. to push a snapshot of stats or to send a ping.
+All methods need to be called from the strand of the owner.
+*/
+class PeriodicTimer {
+public:
+    using Callback = std::function<void()>;
+
+    explicit PeriodicTimer(const boost::asio::any_io_executor& executor);
+
+    // an interval of 0 stops the timer. keepAlive gets held by the timer, so the
+    // owner of the timer outlives it - the owner needs to stop the timer once it gets closed
+    void start(std::chrono::milliseconds interval, Callback callback, std::shared_ptr<void> keepAlive);
+
+    void stop();
+
+private:
+    void schedule(std::shared_ptr<void> keepAlive);
+
+    boost::asio::steady_timer mTimer;
+    std::chrono::milliseconds mInterval { 0 };
+    Callback mCallback;
+    // identifies the current schedule, so a late timer of a previous interval does not fire
+    uint64_t mGeneration = 0;
+};
 
 /** A wrapper class for the websocket communication thread.
 This gets initiated into a static variable upon request.
@@ -1,13 +1,22 @@
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdlib>
+#include <limits>
+#include <mutex>
+#include <system_error>
 #include <thread>
+#include <type_traits>
 
 #include "sc_gluon_v1_entry_points.h"
 #include "sc_gluon_v1_types.h"
 
 #include "ws_client.h"
+#include "ws_handles.h"
+#include "ws_json.h"
+#include "ws_osc.h"
 #include "ws_server.h"
-
-#define SC_WEBSOCKET_DEBUG 1
+#include "ws_trace.h"
 
 static auto* gDeclarations = new std::vector<sc_gluon_function_declarations_v1_t>();
 
@@ -18,23 +27,470 @@ struct WebSocketState {
     sc_gluon_release_callback_object_v1_f releaseCallback;
 
     // ws state
-    std::thread thread;
+    std::vector<std::thread> threads;
     boost::asio::io_context ioContext;
     std::unique_ptr<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> workGuard;
-    std::unordered_map<uint32_t, std::shared_ptr<WebSocketClient>> clients;
-    std::unordered_map<uint32_t, std::shared_ptr<WebSocketListener>> listeners;
-    std::unordered_map<uint32_t, std::shared_ptr<WebSocketSession>> sessions;
+    // drains the trace periodically, see `traceStream`
+    boost::asio::strand<boost::asio::io_context::executor_type> traceStrand = boost::asio::make_strand(ioContext);
+    PeriodicTimer traceTimer { traceStrand };
+    // sessions get inserted and clients and sessions get removed from the io threads,
+    // while sclang looks them up on every call
+    HandleTable<WebSocketClient> clients;
+    HandleTable<WebSocketListener> listeners;
+    HandleTable<WebSocketSession> sessions;
+    // sessions and clients which have been removed after their connection got closed
+    std::atomic<uint32_t> numRetiredSessions = 0;
+    std::atomic<uint32_t> numRetiredClients = 0;
 };
 
-sc_gluon_out_param_tag_v1 returnTrue(sc_gluon_out_param_or_maybe_diagnostic_v1* &outParam) {
+// keeps a gluon callback object alive as long as a copy of the returned pointer exists,
+// so the object gets released once the callback which captured it gets replaced or destroyed
+std::shared_ptr<void> retainCallback(WebSocketState* state, sc_gluon_callable_object_v1_t callbackObject) {
+    return std::shared_ptr<void>(callbackObject, [state](void* object) { state->releaseCallback(object); });
+}
+
+std::shared_ptr<WebSocketSession> findSession(WebSocketState* state, int32_t uuid) {
+    return state->sessions.find(uuid);
+}
+
+std::shared_ptr<WebSocketClient> findClient(WebSocketState* state, int32_t uuid) {
+    return state->clients.find(uuid);
+}
+
+// drops our reference of a closed session - its callback objects get released once
+// the pending operations of the session have completed and it gets destroyed
+void reapSession(WebSocketState* state, int32_t uuid) {
+    if (state->sessions.erase(uuid)) {
+        state->numRetiredSessions++;
+    }
+}
+
+void reapClient(WebSocketState* state, int32_t uuid) {
+    if (state->clients.erase(uuid)) {
+        state->numRetiredClients++;
+    }
+}
+
+// replaces a callback on the strand of its session or client, so it does not get
+// replaced while being invoked
+template <class Owner, class Callback, class Function>
+void installCallback(const std::shared_ptr<Owner>& owner, Callback Owner::*member, Function&& function) {
+    owner->runOnStrand([owner, member, callback = Callback(std::forward<Function>(function))]() mutable {
+        (*owner).*member = std::move(callback);
+    });
+}
+
+// limits the number of IO threads, more threads than cores only add contention
+size_t clampIoThreads(int numThreads) {
+    return std::clamp<size_t>(std::max(numThreads, 1), 1, 4 * std::max(1u, std::thread::hardware_concurrency()));
+}
+
+void startIoThreads(WebSocketState* state, size_t numThreads);
+
+sc_gluon_out_param_tag_v1 returnBool(sc_gluon_out_param_or_maybe_diagnostic_v1* &outParam, bool value) {
     outParam->out_param.tag = sc_gluon_bool;
-    outParam->out_param.data = {true};
+    outParam->out_param.data = {value};
+    outParam->out_param.owns_data = true;
+    outParam->out_param.size = 1;
+
+    return sc_gluon_produced_param;
+}
+
+sc_gluon_out_param_tag_v1 returnInt(sc_gluon_out_param_or_maybe_diagnostic_v1* &outParam, int32_t value) {
+    outParam->out_param.tag = sc_gluon_i32;
+    outParam->out_param.data.i32 = value;
     outParam->out_param.owns_data = true;
     outParam->out_param.size = 1;
 
     return sc_gluon_produced_param;
 }
 
+sc_gluon_out_param_tag_v1 returnTrue(sc_gluon_out_param_or_maybe_diagnostic_v1* &outParam) {
+    return returnBool(outParam, true);
+}
+
+// a session can get retired before sclang has processed its new connection callback,
+// so registering a callback of a retired session returns false instead of failing
+sc_gluon_out_param_tag_v1 returnSessionNotFound(
+    WebSocketState* state,
+    int32_t uuid,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* &outParam
+) {
+    state->releaseCallback(callbackObject);
+    if (state->sessions.isStale(uuid)) {
+        return returnBool(outParam, false);
+    }
+    outParam->maybe_diagnostic = "Provided session handle does not exist";
+    return sc_gluon_error_with_non_owned_diagnostic;
+}
+
+// a non-owned diagnostic has to outlive the call, so the errors a listener can fail to open
+// with get mapped to static messages - the error itself gets traced by the listener
+const char* listenerErrorDiagnostic(const beast::error_code& ec) {
+    if (ec == boost::asio::error::address_in_use) {
+        return "Address already in use";
+    }
+    if (ec == boost::asio::error::access_denied) {
+        return "Permission denied";
+    }
+    if (ec == boost::system::errc::address_not_available) {
+        return "Address not available";
+    }
+    if (ec == boost::asio::error::name_too_long) {
+        return "Path of the unix domain socket is too long";
+    }
+    if (ec == boost::asio::error::operation_not_supported) {
+        return "Unix domain sockets are not supported";
+    }
+    return "Could not open listener";
+}
+
+// reads max messages, max bytes, policy, high watermark, low watermark and disconnect timeout in ms
+// from the params which follow the handle
+QueueLimits paramsToQueueLimits(const sc_gluon_param_v1_t* inParams) {
+    return QueueLimits{
+        .maxMessages = static_cast<size_t>(std::max(0, inParams[1].data.i32)),
+        .maxBytes = static_cast<size_t>(std::max(0, inParams[2].data.i32)),
+        .policy = static_cast<QueuePolicy>(std::clamp(inParams[3].data.i32, 0, 3)),
+        .highWatermark = static_cast<size_t>(std::max(0, inParams[4].data.i32)),
+        .lowWatermark = static_cast<size_t>(std::max(0, inParams[5].data.i32)),
+        .disconnectTimeout = std::chrono::milliseconds(std::max(0, inParams[6].data.i32)),
+    };
+}
+
+KeepAliveOptions paramsToKeepAlive(const sc_gluon_param_v1_t* inParams) {
+    return KeepAliveOptions{
+        .pingInterval = std::chrono::milliseconds(std::max(0, inParams[1].data.i32)),
+        .idleTimeout = std::chrono::milliseconds(std::max(0, inParams[2].data.i32)),
+    };
+}
+
+const sc_gluon_param_v1_t kNilParam {
+    .data = {},
+    .size = 0,
+    .tag = sc_gluon_nil,
+    .owns_data = false,
+};
+
+// wraps a received message into a gluon param without copying it.
+// gluon copies the data into sclang memory within `doCallback`, so the view
+// only has to stay valid until the callback returns.
+sc_gluon_param_v1_t messageToParam(const WebSocketDataView& message) {
+    if (message.isText) {
+        return sc_gluon_param_v1_t{
+            .data = { .character_array = reinterpret_cast<char*>(message.data) },
+            .size = static_cast<uint32_t>(message.size),
+            .tag = sc_gluon_char_array,
+            .owns_data = false,
+        };
+    }
+    return sc_gluon_param_v1_t{
+        .data = { .u8_array = message.data },
+        .size = static_cast<uint32_t>(message.size),
+        .tag = sc_gluon_u8_array,
+        .owns_data = false,
+    };
+}
+
+// reads enabled, server max window bits, client max window bits, no context takeover,
+// compression level and the min message size from the params which follow the handle
+beast::websocket::permessage_deflate paramsToCompression(const sc_gluon_param_v1_t* inParams) {
+    beast::websocket::permessage_deflate compression;
+    compression.server_enable = inParams[1].data.boolean;
+    compression.client_enable = inParams[1].data.boolean;
+    // window bits below 9 are not supported by zlib
+    compression.server_max_window_bits = std::clamp(inParams[2].data.i32, 9, 15);
+    compression.client_max_window_bits = std::clamp(inParams[3].data.i32, 9, 15);
+    compression.server_no_context_takeover = inParams[4].data.boolean;
+    compression.client_no_context_takeover = inParams[4].data.boolean;
+    compression.compLevel = std::clamp(inParams[5].data.i32, 0, 9);
+    compression.msg_size_threshold = static_cast<size_t>(std::max(0, inParams[6].data.i32));
+    return compression;
+}
+
+// reports the ratio of message bytes to bytes on the wire for received and sent messages
+void doCompressionStatsCallback(WebSocketState* state, sc_gluon_callable_object_v1_t callbackObject,
+                                const CompressionStats& stats) {
+    auto ratio = [](uint64_t messageBytes, uint64_t wireBytes) {
+        return wireBytes > 0 ? static_cast<float>(messageBytes) / static_cast<float>(wireBytes) : 1.0f;
+    };
+    sc_gluon_param_v1_t callbackData[] = {
+        {
+            .data = { .f32 = ratio(stats.messageBytesRead, stats.wireBytesRead) },
+            .size = 1,
+            .tag = sc_gluon_f32,
+            .owns_data = false,
+        },
+        {
+            .data = { .f32 = ratio(stats.messageBytesWritten, stats.wireBytesWritten) },
+            .size = 1,
+            .tag = sc_gluon_f32,
+            .owns_data = false,
+        },
+    };
+    state->doCallback(callbackObject, callbackData, 2);
+}
+
+// every message becomes an argument of the callback, followed by the seconds since it
+// has been read, so a batch of messages only needs a single call into sclang.
+// The age ends here - gluon queues the call, so the time until sclang runs it is not included.
+void doMessageCallback(WebSocketState* state, sc_gluon_callable_object_v1_t callbackObject,
+                       const WebSocketDataView* messages, size_t numMessages) {
+    // reused by all callbacks of an io thread
+    thread_local std::vector<sc_gluon_param_v1_t> callbackData;
+    callbackData.clear();
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < numMessages; i++) {
+        callbackData.push_back(messageToParam(messages[i]));
+        callbackData.push_back(sc_gluon_param_v1_t{
+            .data = { .f32 = std::chrono::duration<float>(now - messages[i].receivedAt).count() },
+            .size = 1,
+            .tag = sc_gluon_f32,
+            .owns_data = false,
+        });
+    }
+    state->doCallback(callbackObject, callbackData.data(), static_cast<uint32_t>(callbackData.size()));
+}
+
+// passes a decoded OSC message as the delay of its timetag in seconds, the address
+// and its arguments. OSC types which have no gluon equivalent get converted.
+void doOscCallback(WebSocketState* state, sc_gluon_callable_object_v1_t callbackObject, const OscMessageView& message) {
+    auto floatParam = [](double value) {
+        return sc_gluon_param_v1_t{
+            .data = { .f32 = static_cast<float>(value) },
+            .size = 1,
+            .tag = sc_gluon_f32,
+            .owns_data = false,
+        };
+    };
+    auto intParam = [](int32_t value) {
+        return sc_gluon_param_v1_t{
+            .data = { .i32 = value },
+            .size = 1,
+            .tag = sc_gluon_i32,
+            .owns_data = false,
+        };
+    };
+
+    // reused by all callbacks of an io thread
+    thread_local std::vector<sc_gluon_param_v1_t> callbackData;
+    callbackData.clear();
+    callbackData.push_back(floatParam(oscTimetagToDelay(message.timetag)));
+    callbackData.push_back(sc_gluon_param_v1_t{
+        .data = { .character_array = message.address },
+        .size = static_cast<uint32_t>(message.addressSize),
+        .tag = sc_gluon_char_array,
+        .owns_data = false,
+    });
+    for (size_t i = 0; i < message.numArguments; i++) {
+        const auto& argument = message.arguments[i];
+        switch (argument.type) {
+        case 'i':
+        case 'c':
+        case 'r':
+        case 'm':
+            callbackData.push_back(intParam(argument.i32));
+            break;
+        case 'h':
+            // sclang integers are 32 bit
+            if (argument.i64 >= INT32_MIN && argument.i64 <= INT32_MAX) {
+                callbackData.push_back(intParam(static_cast<int32_t>(argument.i64)));
+            } else {
+                callbackData.push_back(floatParam(static_cast<double>(argument.i64)));
+            }
+            break;
+        case 'f':
+            callbackData.push_back(floatParam(argument.f32));
+            break;
+        case 'd':
+            callbackData.push_back(floatParam(argument.f64));
+            break;
+        case 't':
+            callbackData.push_back(floatParam(oscTimetagToDelay(argument.timetag)));
+            break;
+        case 's':
+        case 'S':
+            callbackData.push_back(sc_gluon_param_v1_t{
+                .data = { .character_array = reinterpret_cast<char*>(argument.data) },
+                .size = static_cast<uint32_t>(argument.size),
+                .tag = sc_gluon_char_array,
+                .owns_data = false,
+            });
+            break;
+        case 'b':
+            callbackData.push_back(sc_gluon_param_v1_t{
+                .data = { .u8_array = argument.data },
+                .size = static_cast<uint32_t>(argument.size),
+                .tag = sc_gluon_u8_array,
+                .owns_data = false,
+            });
+            break;
+        case 'T':
+        case 'F':
+            callbackData.push_back(sc_gluon_param_v1_t{
+                .data = { .boolean = argument.type == 'T' },
+                .size = 1,
+                .tag = sc_gluon_bool,
+                .owns_data = false,
+            });
+            break;
+        case 'N':
+            callbackData.push_back(kNilParam);
+            break;
+        case 'I':
+            // infinitum becomes inf in sclang
+            callbackData.push_back(floatParam(std::numeric_limits<double>::infinity()));
+            break;
+        default:
+            break;
+        }
+    }
+    state->doCallback(callbackObject, callbackData.data(), static_cast<uint32_t>(callbackData.size()));
+}
+
+// passes decoded JSON as pointer/value pairs. null becomes nil, an empty object or
+// array has no sclang equivalent and gets passed as an Int8Array containing `{` or `[`.
+void doJsonCallback(
+    WebSocketState* state, sc_gluon_callable_object_v1_t callbackObject, const JsonField* fields, size_t numFields
+) {
+    static uint8_t emptyObject = '{';
+    static uint8_t emptyArray = '[';
+    auto marker = [](uint8_t* data, uint32_t size) {
+        return sc_gluon_param_v1_t{
+            .data = { .u8_array = data },
+            .size = size,
+            .tag = sc_gluon_u8_array,
+            .owns_data = false,
+        };
+    };
+    auto number = [](auto value) {
+        // sclang integers are 32 bit
+        using Number = decltype(value);
+        if constexpr (std::is_integral_v<Number>) {
+            auto fits = value <= static_cast<Number>(INT32_MAX);
+            if constexpr (std::is_signed_v<Number>) {
+                fits = fits && value >= INT32_MIN;
+            }
+            if (fits) {
+                return sc_gluon_param_v1_t{
+                    .data = { .i32 = static_cast<int32_t>(value) },
+                    .size = 1,
+                    .tag = sc_gluon_i32,
+                    .owns_data = false,
+                };
+            }
+        }
+        return sc_gluon_param_v1_t{
+            .data = { .f32 = static_cast<float>(value) },
+            .size = 1,
+            .tag = sc_gluon_f32,
+            .owns_data = false,
+        };
+    };
+
+    // reused by all callbacks of an io thread
+    thread_local std::vector<sc_gluon_param_v1_t> callbackData;
+    callbackData.clear();
+    for (size_t i = 0; i < numFields; i++) {
+        const auto& field = fields[i];
+        callbackData.push_back(sc_gluon_param_v1_t{
+            .data = { .character_array = const_cast<char*>(field.pointer.data()) },
+            .size = static_cast<uint32_t>(field.pointer.size()),
+            .tag = sc_gluon_char_array,
+            .owns_data = false,
+        });
+        const auto& value = *field.value;
+        switch (value.kind()) {
+        case boost::json::kind::bool_:
+            callbackData.push_back(sc_gluon_param_v1_t{
+                .data = { .boolean = value.get_bool() },
+                .size = 1,
+                .tag = sc_gluon_bool,
+                .owns_data = false,
+            });
+            break;
+        case boost::json::kind::int64:
+            callbackData.push_back(number(value.get_int64()));
+            break;
+        case boost::json::kind::uint64:
+            callbackData.push_back(number(value.get_uint64()));
+            break;
+        case boost::json::kind::double_:
+            callbackData.push_back(number(value.get_double()));
+            break;
+        case boost::json::kind::string:
+            callbackData.push_back(sc_gluon_param_v1_t{
+                .data = { .character_array = const_cast<char*>(value.get_string().data()) },
+                .size = static_cast<uint32_t>(value.get_string().size()),
+                .tag = sc_gluon_char_array,
+                .owns_data = false,
+            });
+            break;
+        case boost::json::kind::object:
+            callbackData.push_back(marker(&emptyObject, 1));
+            break;
+        case boost::json::kind::array:
+            callbackData.push_back(marker(&emptyArray, 1));
+            break;
+        case boost::json::kind::null:
+            callbackData.push_back(kNilParam);
+            break;
+        }
+    }
+    state->doCallback(callbackObject, callbackData.data(), static_cast<uint32_t>(callbackData.size()));
+}
+
+// passes a snapshot of stats as pointer/value pairs like `doJsonCallback`,
+// so sclang does not have to parse the JSON on the interpreter thread
+void doStatsCallback(WebSocketState* state, sc_gluon_callable_object_v1_t callbackObject, const std::string& json) {
+    // reused by all stats callbacks of a thread, so its buffers only grow once
+    thread_local JsonDecoder decoder;
+    decoder.parse(json.data(), json.size(), [&](const JsonField* fields, size_t numFields) {
+        doJsonCallback(state, callbackObject, fields, numFields);
+    });
+}
+
+// splits a newline separated list, e.g. the pointers of a JSON subscription
+std::vector<std::string> paramToLines(const sc_gluon_param_v1_t& param) {
+    std::vector<std::string> lines;
+    std::string_view text(param.data.character_array, param.size);
+    while (!text.empty()) {
+        auto end = text.find('\n');
+        if (auto line = text.substr(0, end); !line.empty()) {
+            lines.emplace_back(line);
+        }
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+    }
+    return lines;
+}
+
+// parameters are host, port and newline separated mirror prefixes - a port of 0 disables relaying
+bool paramsToUdpRelayConfig(const sc_gluon_param_v1_t* params, UdpRelayConfig& config) {
+    auto port = params[1].data.i32;
+    if (port == 0) {
+        config = UdpRelayConfig();
+        return true;
+    }
+    boost::system::error_code ec;
+    auto address = boost::asio::ip::make_address(std::string(params[0].data.character_array, params[0].size), ec);
+    if (ec || port < 0 || port > 65535) {
+        return false;
+    }
+    config.target = boost::asio::ip::udp::endpoint(address, static_cast<unsigned short>(port));
+    config.mirrorPrefixes = paramToLines(params[2]);
+    return true;
+}
+
+// copies the message data out of sclang memory - this is the only copy of
+// an outbound message until it gets written to the socket
+WebSocketPayload paramToPayload(bool isString, const sc_gluon_param_v1_t& param) {
+    if (isString) {
+        return WebSocketPayload::copyFrom(param.data.character_array, param.size, true);
+    }
+    return WebSocketPayload::copyFrom(param.data.u8_array, param.size, false);
+}
+
 sc_gluon_out_param_tag_v1 webSocketClientInit(
     sc_gluon_library_data_v1_t libraryData,
     sc_gluon_callable_object_v1_t callbackObject,
@@ -42,20 +498,24 @@ sc_gluon_out_param_tag_v1 webSocketClientInit(
     uint32_t numInParams,
     sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
 ) {
-    if (numInParams != 3) {
+    if (numInParams != 2) {
         outParam->maybe_diagnostic = "Wrong number of arguments";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
     auto const state = static_cast<WebSocketState*>(libraryData);
 
-    auto uuid = inParams[0].data.i32;
-    auto host = std::string(inParams[1].data.character_array, inParams[1].size);
-    auto port = inParams[2].data.i32;
+    auto host = std::string(inParams[0].data.character_array, inParams[0].size);
+    auto port = inParams[1].data.i32;
 
     auto client = std::make_shared<WebSocketClient>(state->ioContext, host, port);
-    state->clients.insert(std::pair<uint32_t, std::shared_ptr<WebSocketClient>>(uuid, client));
+    auto handle = state->clients.insert(client);
+    if (handle == HandleTable<WebSocketClient>::kInvalidHandle) {
+        outParam->maybe_diagnostic = "Too many clients";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    client->setHandle(handle);
 
-    return returnTrue(outParam);
+    return returnInt(outParam, handle);
 }
 
 
@@ -66,32 +526,90 @@ sc_gluon_out_param_tag_v1 webSocketClientConnect(
     uint32_t numInParams,
     sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
 ) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
     if (numInParams != 1 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
         outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
 
-    auto const state = static_cast<WebSocketState*>(libraryData);
-
     auto uuid = inParams[0].data.i32;
-    if (auto it = state->clients.find(uuid); it != state->clients.end()) {
-        auto client = it->second;
-        client->mSclangConnectionChangeCallback = [=](bool isConnected) {
-            auto callbackData = sc_gluon_param_v1_t{
-                .data = {isConnected},
-                .size = 1,
-                .tag = sc_gluon_bool,
-                .owns_data = false,
-            };
-            state->doCallback(callbackObject, &callbackData, 1);
-        };
+    if (auto client = findClient(state, uuid)) {
+        auto callback = retainCallback(state, callbackObject);
+        installCallback(
+            client,
+            &WebSocketClient::mSclangConnectionChangeCallback,
+            [=](bool isConnected, uint32_t epoch, bool willReconnect) {
+                sc_gluon_param_v1_t callbackData[3] = {
+                    {
+                        .data = { .boolean = isConnected },
+                        .size = 1,
+                        .tag = sc_gluon_bool,
+                        .owns_data = false,
+                    },
+                    {
+                        .data = { .i32 = static_cast<int32_t>(epoch) },
+                        .size = 1,
+                        .tag = sc_gluon_i32,
+                        .owns_data = false,
+                    },
+                    {
+                        .data = { .boolean = willReconnect },
+                        .size = 1,
+                        .tag = sc_gluon_bool,
+                        .owns_data = false,
+                    },
+                };
+                state->doCallback(callback.get(), callbackData, 3);
+                // a closed client can not be connected again
+                if (!isConnected && !willReconnect) {
+                    reapClient(state, uuid);
+                }
+            }
+        );
         client->connect();
 
         return returnTrue(outParam);
     } else {
-        outParam->maybe_diagnostic = "Provided client uuid does not exist";
+        state->releaseCallback(callbackObject);
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+}
+
+sc_gluon_out_param_tag_v1 webSocketClientReconnect(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 8) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    auto policy = ReconnectPolicy{
+        .enabled = inParams[1].data.boolean,
+        .initialDelay = std::chrono::milliseconds(std::max(0, inParams[2].data.i32)),
+        .maxDelay = std::chrono::milliseconds(std::max(0, inParams[3].data.i32)),
+        .multiplier = std::max(1.0f, inParams[4].data.f32),
+        .jitter = std::clamp(inParams[5].data.f32, 0.0f, 1.0f),
+        .maxAttempts = static_cast<uint32_t>(std::max(0, inParams[6].data.i32)),
+        .maxHeldMessages = static_cast<size_t>(std::max(0, inParams[7].data.i32)),
+    };
+    if (auto client = findClient(state, uuid)) {
+        client->setReconnectPolicy(policy);
+    } else {
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
+
+    return returnTrue(outParam);
 }
 
 sc_gluon_out_param_tag_v1 webSocketClientRegisterMessageCallback(
@@ -101,106 +619,108 @@ sc_gluon_out_param_tag_v1 webSocketClientRegisterMessageCallback(
     uint32_t numInParams,
     sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
 ) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
     if (numInParams != 1 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
         outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
-    auto const state = static_cast<WebSocketState*>(libraryData);
 
     auto uuid = inParams[0].data.i32;
-    if (auto it = state->clients.find(uuid); it != state->clients.end()) {
-        auto client = it->second;
-        client->mSclangOnMessageCallback = [=](WebSocketData& message) {
-
-            if (std::holds_alternative<std::string>(message)) {
-                auto stringMessage = std::get<std::string>(message);
-                auto callbackData = sc_gluon_param_v1_t{
-                    .data = { .character_array = stringMessage.data() },
-                    .size = static_cast<uint32_t>(stringMessage.size()),
-                    .tag = sc_gluon_char_array,
-                    .owns_data = false,
-                };
-                state->doCallback(callbackObject, &callbackData, 1);
-            } else {
-                auto bitMessage = std::get<std::vector<uint8_t>>(message);
-                auto callbackData = sc_gluon_param_v1_t{
-                    .data = { .u8_array = bitMessage.data() },
-                    .size = static_cast<uint32_t>(bitMessage.size()),
-                    .tag = sc_gluon_u8_array,
-                    .owns_data = false,
-                };
-                state->doCallback(callbackObject, &callbackData, 1);
+    if (auto client = findClient(state, uuid)) {
+        auto callback = retainCallback(state, callbackObject);
+        installCallback(
+            client, &WebSocketClient::mSclangOnMessageCallback,
+            [=](const WebSocketDataView* messages, size_t numMessages) {
+                doMessageCallback(state, callback.get(), messages, numMessages);
             }
-        };
+        );
         return returnTrue(outParam);
     } else {
-        outParam->maybe_diagnostic = "Provided client uuid does not exist";
+        state->releaseCallback(callbackObject);
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
 }
 
-sc_gluon_out_param_tag_v1 webSocketClientSendMessage(
+sc_gluon_out_param_tag_v1 webSocketClientOscCallback(
     sc_gluon_library_data_v1_t libraryData,
     sc_gluon_callable_object_v1_t callbackObject,
     sc_gluon_param_v1_t* inParams,
     uint32_t numInParams,
     sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
 ) {
-    if (numInParams != 3) {
-        outParam->maybe_diagnostic = "Wrong number of arguments";
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 2 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
-    auto const state = static_cast<WebSocketState*>(libraryData);
 
     auto uuid = inParams[0].data.i32;
-    if (auto it = state->clients.find(uuid); it != state->clients.end()) {
-        auto client = it->second;
-
-        if (inParams[1].data.boolean) {
-            auto messageString = std::string(inParams[2].data.character_array, inParams[2].size);
-            auto message = WebSocketData{messageString};
-            client->enqueueMessage(message);
+    auto enabled = inParams[1].data.boolean;
+    if (auto client = findClient(state, uuid)) {
+        if (enabled) {
+            auto callback = retainCallback(state, callbackObject);
+            installCallback(client, &WebSocketClient::mSclangOscMessageCallback, [=](const OscMessageView& message) {
+                doOscCallback(state, callback.get(), message);
+            });
         } else {
-            auto u8Data = std::vector<u_int8_t>(inParams[2].data.u8_array, inParams[2].data.u8_array + inParams[2].size);
-            auto message = WebSocketData{u8Data};
-            client->enqueueMessage(message);
+            installCallback(client, &WebSocketClient::mSclangOscMessageCallback, nullptr);
+            state->releaseCallback(callbackObject);
         }
-        return returnTrue(outParam);
     } else {
-        outParam->maybe_diagnostic = "Provided client uuid does not exist";
+        state->releaseCallback(callbackObject);
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
+
+    return returnTrue(outParam);
 }
 
-sc_gluon_out_param_tag_v1 webSocketClientCloseConnection(
+sc_gluon_out_param_tag_v1 webSocketClientJsonCallback(
     sc_gluon_library_data_v1_t libraryData,
     sc_gluon_callable_object_v1_t callbackObject,
     sc_gluon_param_v1_t* inParams,
     uint32_t numInParams,
     sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
 ) {
-    if (numInParams != 1) {
-        outParam->maybe_diagnostic = "Wrong number of arguments";
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 3 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
 
-    auto const state = static_cast<WebSocketState*>(libraryData);
-
     auto uuid = inParams[0].data.i32;
-    if (auto it = state->clients.find(uuid); it != state->clients.end()) {
-        auto client = it->second;
-        client->closeConnection();
+    auto enabled = inParams[1].data.boolean;
+    if (auto client = findClient(state, uuid)) {
+        client->setJsonPointers(paramToLines(inParams[2]));
+        if (enabled) {
+            auto callback = retainCallback(state, callbackObject);
+            installCallback(client, &WebSocketClient::mSclangJsonCallback, [=](const JsonField* fields, size_t num) {
+                doJsonCallback(state, callback.get(), fields, num);
+            });
+        } else {
+            installCallback(client, &WebSocketClient::mSclangJsonCallback, nullptr);
+            state->releaseCallback(callbackObject);
+        }
     } else {
-        outParam->maybe_diagnostic = "Provided client uuid does not exist";
+        state->releaseCallback(callbackObject);
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
 
     return returnTrue(outParam);
 }
 
-// server declarations
-
-sc_gluon_out_param_tag_v1 webSocketListenerInit(
+sc_gluon_out_param_tag_v1 webSocketClientSendMessage(
     sc_gluon_library_data_v1_t libraryData,
     sc_gluon_callable_object_v1_t callbackObject,
     sc_gluon_param_v1_t* inParams,
@@ -214,217 +734,1241 @@ sc_gluon_out_param_tag_v1 webSocketListenerInit(
     auto const state = static_cast<WebSocketState*>(libraryData);
 
     auto uuid = inParams[0].data.i32;
-    auto host = std::string(inParams[1].data.character_array, inParams[1].size);
-    auto port = inParams[2].data.i32;
-
-    beast::error_code ec;
-    auto listener = std::make_shared<WebSocketListener>(
-        state->ioContext,
-        host,
-        port,
-        ec
-    );
+    if (auto client = findClient(state, uuid)) {
 
-    if (ec) {
-        outParam->maybe_diagnostic = ec.message().c_str();
+        // a full queue with a reject policy gets reported back to sclang
+        if (!client->acceptsMessage(inParams[2].size)) {
+            return returnBool(outParam, false);
+        }
+        return returnBool(outParam, client->enqueueMessage(paramToPayload(inParams[1].data.boolean, inParams[2])));
+    } else {
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
-    state->listeners.insert(std::pair<uint32_t, std::shared_ptr<WebSocketListener>>(uuid, listener));
-
-    return returnTrue(outParam);
 }
 
-
-sc_gluon_out_param_tag_v1 webSocketListenerStartStop(
+sc_gluon_out_param_tag_v1 webSocketClientSendKeyed(
     sc_gluon_library_data_v1_t libraryData,
     sc_gluon_callable_object_v1_t callbackObject,
     sc_gluon_param_v1_t* inParams,
     uint32_t numInParams,
     sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
 ) {
-    if (numInParams != 2) {
+    if (numInParams != 4) {
         outParam->maybe_diagnostic = "Wrong number of arguments";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
-
     auto const state = static_cast<WebSocketState*>(libraryData);
 
     auto uuid = inParams[0].data.i32;
-    auto startConnection = inParams[1].data.boolean;
-
-    if (auto it = state->listeners.find(uuid); it != state->listeners.end()) {
-        auto listener = it->second;
-
-        if (startConnection) {
-            listener->run();
-        } else {
-            listener->stop();
-        }
+    auto key = std::string(inParams[1].data.character_array, inParams[1].size);
+    auto isString = inParams[2].data.boolean;
+    if (auto client = findClient(state, uuid)) {
+        client->enqueueKeyedMessage(std::move(key), paramToPayload(isString, inParams[3]));
     } else {
-        outParam->maybe_diagnostic = "Provided listener uuid does not exist";
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
 
     return returnTrue(outParam);
 }
 
-sc_gluon_out_param_tag_v1 webSocketListenerNewConnectionCallback(
+sc_gluon_out_param_tag_v1 webSocketClientSendAt(
     sc_gluon_library_data_v1_t libraryData,
     sc_gluon_callable_object_v1_t callbackObject,
     sc_gluon_param_v1_t* inParams,
     uint32_t numInParams,
     sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
 ) {
-    if (numInParams != 1 || callbackObject == nullptr) {
-        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+    if (numInParams != 4) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
-
     auto const state = static_cast<WebSocketState*>(libraryData);
 
     auto uuid = inParams[0].data.i32;
-
-    if (auto it = state->listeners.find(uuid); it != state->listeners.end()) {
-        auto listener = it->second;
-
-        listener->mNewSessionCallback = [=](std::shared_ptr<WebSocketSession> session) {
-            state->sessions.insert(std::make_pair(session->getSessionId(), session));
-            auto callbackData = sc_gluon_param_v1_t{
-                .data = { .i32 = session->getSessionId() },
-                .size = 1,
-                .tag = sc_gluon_i32,
-                .owns_data = false,
-            };
-            state->doCallback(callbackObject, &callbackData, 1);
-        };
+    // the delay gets turned into a time right away, so the time spent waiting for the strand does not add up
+    auto time = std::chrono::steady_clock::now() + std::chrono::microseconds(inParams[1].data.i32);
+    auto isString = inParams[2].data.boolean;
+    if (auto client = findClient(state, uuid)) {
+        client->enqueueMessageAt(time, paramToPayload(isString, inParams[3]));
     } else {
-        outParam->maybe_diagnostic = "Provided listener uuid does not exist";
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
 
     return returnTrue(outParam);
 }
 
-sc_gluon_out_param_tag_v1 webSocketSessionSendMessage(
+sc_gluon_out_param_tag_v1 webSocketClientSendBatch(
     sc_gluon_library_data_v1_t libraryData,
     sc_gluon_callable_object_v1_t callbackObject,
     sc_gluon_param_v1_t* inParams,
     uint32_t numInParams,
     sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
 ) {
-    if (numInParams != 3) {
+    if (numInParams != 2) {
         outParam->maybe_diagnostic = "Wrong number of arguments";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
-
     auto const state = static_cast<WebSocketState*>(libraryData);
 
     auto uuid = inParams[0].data.i32;
-    auto isString = inParams[1].data.boolean;
-
-    if (auto it = state->sessions.find(uuid); it != state->sessions.end()) {
-        auto session = it->second;
-
-        WebSocketData message;
-        if (isString) {
-            message = WebSocketData(std::string(inParams[2].data.character_array, inParams[2].size));
-        } else {
-            message = WebSocketData(std::vector<u_int8_t>(inParams[2].data.u8_array, inParams[2].data.u8_array + inParams[2].size));
+    if (auto client = findClient(state, uuid)) {
+        std::vector<WebSocketPayload> messages;
+        if (!unpackBatch(inParams[1].data.u8_array, inParams[1].size, messages)) {
+            outParam->maybe_diagnostic = "Malformed message batch";
+            return sc_gluon_error_with_non_owned_diagnostic;
         }
-        session->enqueueMessage(message);
+        client->enqueueMessages(std::move(messages));
+        return returnTrue(outParam);
     } else {
-        outParam->maybe_diagnostic = "Provided session uuid does not exist";
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
-
-    return returnTrue(outParam);
 }
 
-sc_gluon_out_param_tag_v1 webSocketSessionConnectionStateCallback(
+sc_gluon_out_param_tag_v1 webSocketClientMessageBatching(
     sc_gluon_library_data_v1_t libraryData,
     sc_gluon_callable_object_v1_t callbackObject,
     sc_gluon_param_v1_t* inParams,
     uint32_t numInParams,
     sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
 ) {
-    if (numInParams != 1 || callbackObject == nullptr) {
-        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+    if (numInParams != 4) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
-
     auto const state = static_cast<WebSocketState*>(libraryData);
 
     auto uuid = inParams[0].data.i32;
-
-    if (auto it = state->sessions.find(uuid); it != state->sessions.end()) {
-        auto session = it->second;
-
-        session->mConnectionStateCallback = [=](bool isConnected) {
-            auto callbackData = sc_gluon_param_v1_t{
-                .data = { .boolean = isConnected },
-                .size = 1,
-                .tag = sc_gluon_bool,
-                .owns_data = false,
-            };
-            state->doCallback(callbackObject, &callbackData, 1);
-        };
+    auto maxMessages = std::max(0, inParams[1].data.i32);
+    auto maxBytes = std::max(0, inParams[2].data.i32);
+    auto maxLatency = std::chrono::microseconds(std::max(0, inParams[3].data.i32));
+    if (auto client = findClient(state, uuid)) {
+        client->setMessageBatching(maxMessages, maxBytes, maxLatency);
     } else {
-        outParam->maybe_diagnostic = "Provided session uuid does not exist";
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
 
     return returnTrue(outParam);
 }
 
-sc_gluon_out_param_tag_v1 webSocketSessionMessageCallback(
+sc_gluon_out_param_tag_v1 webSocketClientQueueLimits(
     sc_gluon_library_data_v1_t libraryData,
     sc_gluon_callable_object_v1_t callbackObject,
     sc_gluon_param_v1_t* inParams,
     uint32_t numInParams,
     sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
 ) {
-    if (numInParams != 1 || callbackObject == nullptr) {
-        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+    if (numInParams != 7) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
-
     auto const state = static_cast<WebSocketState*>(libraryData);
 
     auto uuid = inParams[0].data.i32;
+    if (auto client = findClient(state, uuid)) {
+        client->setQueueLimits(paramsToQueueLimits(inParams));
+    } else {
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketClientQueueStateCallback(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 1 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto uuid = inParams[0].data.i32;
+    if (auto client = findClient(state, uuid)) {
+        auto callback = retainCallback(state, callbackObject);
+        installCallback(client, &WebSocketClient::mSclangQueueStateCallback, [=](bool isAboveHighWatermark) {
+            auto callbackData = sc_gluon_param_v1_t{
+                .data = { .boolean = isAboveHighWatermark },
+                .size = 1,
+                .tag = sc_gluon_bool,
+                .owns_data = false,
+            };
+            state->doCallback(callback.get(), &callbackData, 1);
+        });
+    } else {
+        state->releaseCallback(callbackObject);
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketClientKeepAlive(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 3) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    if (auto client = findClient(state, uuid)) {
+        client->setKeepAlive(paramsToKeepAlive(inParams));
+    } else {
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketClientCompression(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 7) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    if (auto client = findClient(state, uuid)) {
+        client->setCompression(paramsToCompression(inParams));
+    } else {
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketClientCompressionStats(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 1 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto uuid = inParams[0].data.i32;
+    if (auto client = findClient(state, uuid)) {
+        doCompressionStatsCallback(state, callbackObject, client->getCompressionStats());
+        // the callback only gets called once
+        state->releaseCallback(callbackObject);
+    } else {
+        state->releaseCallback(callbackObject);
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketClientStats(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 1 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto uuid = inParams[0].data.i32;
+    if (auto client = findClient(state, uuid)) {
+        doStatsCallback(state, callbackObject, client->getStatsJson());
+        // the callback only gets called once
+        state->releaseCallback(callbackObject);
+    } else {
+        state->releaseCallback(callbackObject);
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketClientStatsInterval(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 2 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto uuid = inParams[0].data.i32;
+    auto interval = std::chrono::milliseconds(std::max(0, inParams[1].data.i32));
+    if (auto client = findClient(state, uuid)) {
+        if (interval.count() > 0) {
+            auto callback = retainCallback(state, callbackObject);
+            client->setStatsInterval(interval, [=](const std::string& json) {
+                doStatsCallback(state, callback.get(), json);
+            });
+        } else {
+            client->setStatsInterval(interval, nullptr);
+            state->releaseCallback(callbackObject);
+        }
+    } else {
+        state->releaseCallback(callbackObject);
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketClientCloseConnection(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 1) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    if (auto client = findClient(state, uuid)) {
+        client->closeConnection();
+    } else {
+        outParam->maybe_diagnostic = "Provided client handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketClientFree(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 1) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    // a closed client has already been released
+    if (auto client = findClient(state, uuid)) {
+        // the client gets destroyed once its pending operations have completed
+        client->closeConnection();
+        reapClient(state, uuid);
+    }
+
+    return returnTrue(outParam);
+}
+
+// server declarations
+
+sc_gluon_out_param_tag_v1 webSocketListenerInit(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 2) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto host = std::string(inParams[0].data.character_array, inParams[0].size);
+    auto port = inParams[1].data.i32;
+
+    beast::error_code ec;
+    auto listener = std::make_shared<WebSocketListener>(
+        state->ioContext,
+        host,
+        port,
+        ec
+    );
+
+    if (ec) {
+        outParam->maybe_diagnostic = listenerErrorDiagnostic(ec);
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    listener->setSessionRetiredCallback([state](WebSocketSession& session) {
+        reapSession(state, session.getHandle());
+    });
+    auto handle = state->listeners.insert(listener);
+    if (handle == HandleTable<WebSocketListener>::kInvalidHandle) {
+        outParam->maybe_diagnostic = "Too many listeners";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnInt(outParam, handle);
+}
+
+
+sc_gluon_out_param_tag_v1 webSocketListenerStartStop(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 2) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    auto startConnection = inParams[1].data.boolean;
+
+    if (auto listener = state->listeners.find(uuid)) {
+
+        if (startConnection) {
+            listener->run();
+        } else {
+            listener->stop();
+        }
+    } else {
+        outParam->maybe_diagnostic = "Provided listener handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketListenerCompression(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 7) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    if (auto listener = state->listeners.find(uuid)) {
+        listener->setCompression(paramsToCompression(inParams));
+    } else {
+        outParam->maybe_diagnostic = "Provided listener handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketListenerKeepAlive(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 3) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    if (auto listener = state->listeners.find(uuid)) {
+        listener->setKeepAlive(paramsToKeepAlive(inParams));
+    } else {
+        outParam->maybe_diagnostic = "Provided listener handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketListenerTopicControlFrames(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 2) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    if (auto listener = state->listeners.find(uuid)) {
+        listener->setTopicControlFrames(inParams[1].data.boolean);
+    } else {
+        outParam->maybe_diagnostic = "Provided listener handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketListenerPublish(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 4) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    auto topic = std::string(inParams[1].data.character_array, inParams[1].size);
+    auto isString = inParams[2].data.boolean;
+
+    if (auto listener = state->listeners.find(uuid)) {
+        // the payload gets shared by all subscribed sessions, so the data only gets copied once
+        listener->publish(topic, paramToPayload(isString, inParams[3]));
+    } else {
+        outParam->maybe_diagnostic = "Provided listener handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketListenerUdpRelay(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 4) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    UdpRelayConfig config;
+    if (!paramsToUdpRelayConfig(inParams + 1, config)) {
+        outParam->maybe_diagnostic = "Invalid UDP relay address";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    if (auto listener = state->listeners.find(uuid)) {
+        listener->setUdpRelay(config);
+    } else {
+        outParam->maybe_diagnostic = "Provided listener handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketListenerNewConnectionCallback(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 1 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto uuid = inParams[0].data.i32;
+
+    if (auto listener = state->listeners.find(uuid)) {
+        auto callback = retainCallback(state, callbackObject);
+        listener->setNewSessionCallback([=](std::shared_ptr<WebSocketSession> session) {
+            auto handle = state->sessions.insert(session);
+            if (handle == HandleTable<WebSocketSession>::kInvalidHandle) {
+                trace(TraceEvent::tooManySessions, session->getSessionId());
+                return;
+            }
+            session->setHandle(handle);
+            auto callbackData = sc_gluon_param_v1_t{
+                .data = { .i32 = handle },
+                .size = 1,
+                .tag = sc_gluon_i32,
+                .owns_data = false,
+            };
+            state->doCallback(callback.get(), &callbackData, 1);
+        });
+    } else {
+        state->releaseCallback(callbackObject);
+        outParam->maybe_diagnostic = "Provided listener handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketListenerSessionRetiredCallback(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 1 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto uuid = inParams[0].data.i32;
+    if (auto listener = state->listeners.find(uuid)) {
+        auto callback = retainCallback(state, callbackObject);
+        listener->setSessionRetiredCallback([=](WebSocketSession& session) {
+            reapSession(state, session.getHandle());
+            auto callbackData = sc_gluon_param_v1_t{
+                .data = { .i32 = session.getHandle() },
+                .size = 1,
+                .tag = sc_gluon_i32,
+                .owns_data = false,
+            };
+            state->doCallback(callback.get(), &callbackData, 1);
+        });
+    } else {
+        state->releaseCallback(callbackObject);
+        outParam->maybe_diagnostic = "Provided listener handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketListenerStats(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 1 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto uuid = inParams[0].data.i32;
+    if (auto listener = state->listeners.find(uuid)) {
+        doStatsCallback(state, callbackObject, listener->getStatsJson());
+        // the callback only gets called once
+        state->releaseCallback(callbackObject);
+    } else {
+        state->releaseCallback(callbackObject);
+        outParam->maybe_diagnostic = "Provided listener handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketListenerStatsInterval(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 2 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto uuid = inParams[0].data.i32;
+    auto interval = std::chrono::milliseconds(std::max(0, inParams[1].data.i32));
+    if (auto listener = state->listeners.find(uuid)) {
+        if (interval.count() > 0) {
+            auto callback = retainCallback(state, callbackObject);
+            listener->setStatsInterval(interval, [=](const std::string& json) {
+                doStatsCallback(state, callback.get(), json);
+            });
+        } else {
+            listener->setStatsInterval(interval, nullptr);
+            state->releaseCallback(callbackObject);
+        }
+    } else {
+        state->releaseCallback(callbackObject);
+        outParam->maybe_diagnostic = "Provided listener handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketListenerBroadcast(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 3) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    auto isString = inParams[1].data.boolean;
+
+    if (auto listener = state->listeners.find(uuid)) {
+        // the payload gets shared by all sessions, so the data only gets copied once
+        listener->broadcast(paramToPayload(isString, inParams[2]));
+    } else {
+        outParam->maybe_diagnostic = "Provided listener handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionSendMessage(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 3) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    auto isString = inParams[1].data.boolean;
+
+    if (auto session = findSession(state, uuid)) {
+        // a full queue with a reject policy gets reported back to sclang
+        if (!session->acceptsMessage(inParams[2].size)) {
+            return returnBool(outParam, false);
+        }
+        return returnBool(outParam, session->enqueueMessage(paramToPayload(isString, inParams[2])));
+    } else {
+        outParam->maybe_diagnostic = "Provided session handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionSendKeyed(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 4) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    auto key = std::string(inParams[1].data.character_array, inParams[1].size);
+    auto isString = inParams[2].data.boolean;
+    if (auto session = findSession(state, uuid)) {
+        session->enqueueKeyedMessage(std::move(key), paramToPayload(isString, inParams[3]));
+    } else {
+        outParam->maybe_diagnostic = "Provided session handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionSendAt(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 4) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    // the delay gets turned into a time right away, so the time spent waiting for the strand does not add up
+    auto time = std::chrono::steady_clock::now() + std::chrono::microseconds(inParams[1].data.i32);
+    auto isString = inParams[2].data.boolean;
+    if (auto session = findSession(state, uuid)) {
+        session->enqueueMessageAt(time, paramToPayload(isString, inParams[3]));
+    } else {
+        outParam->maybe_diagnostic = "Provided session handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionSendBatch(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 2) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    if (auto session = findSession(state, uuid)) {
+        std::vector<WebSocketPayload> messages;
+        if (!unpackBatch(inParams[1].data.u8_array, inParams[1].size, messages)) {
+            outParam->maybe_diagnostic = "Malformed message batch";
+            return sc_gluon_error_with_non_owned_diagnostic;
+        }
+        session->enqueueMessages(std::move(messages));
+        return returnTrue(outParam);
+    } else {
+        outParam->maybe_diagnostic = "Provided session handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionConnectionStateCallback(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 1 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto uuid = inParams[0].data.i32;
+
+    if (auto session = findSession(state, uuid)) {
+        auto callback = retainCallback(state, callbackObject);
+        installCallback(session, &WebSocketSession::mConnectionStateCallback, [=](bool isConnected) {
+            auto callbackData = sc_gluon_param_v1_t{
+                .data = { .boolean = isConnected },
+                .size = 1,
+                .tag = sc_gluon_bool,
+                .owns_data = false,
+            };
+            state->doCallback(callback.get(), &callbackData, 1);
+        });
+    } else {
+        return returnSessionNotFound(state, uuid, callbackObject, outParam);
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionMessageCallback(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 1 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto uuid = inParams[0].data.i32;
+
+    if (auto session = findSession(state, uuid)) {
+        auto callback = retainCallback(state, callbackObject);
+        installCallback(
+            session, &WebSocketSession::mMessageReceivedCallback,
+            [=](const WebSocketDataView* messages, size_t numMessages) {
+                doMessageCallback(state, callback.get(), messages, numMessages);
+            }
+        );
+    } else {
+        return returnSessionNotFound(state, uuid, callbackObject, outParam);
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionOscCallback(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 2 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto uuid = inParams[0].data.i32;
+    auto enabled = inParams[1].data.boolean;
+    if (auto session = findSession(state, uuid)) {
+        if (enabled) {
+            auto callback = retainCallback(state, callbackObject);
+            installCallback(session, &WebSocketSession::mOscMessageCallback, [=](const OscMessageView& message) {
+                doOscCallback(state, callback.get(), message);
+            });
+        } else {
+            installCallback(session, &WebSocketSession::mOscMessageCallback, nullptr);
+            state->releaseCallback(callbackObject);
+        }
+    } else {
+        return returnSessionNotFound(state, uuid, callbackObject, outParam);
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionJsonCallback(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 3 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto uuid = inParams[0].data.i32;
+    auto enabled = inParams[1].data.boolean;
+    if (auto session = findSession(state, uuid)) {
+        session->setJsonPointers(paramToLines(inParams[2]));
+        if (enabled) {
+            auto callback = retainCallback(state, callbackObject);
+            installCallback(session, &WebSocketSession::mJsonCallback, [=](const JsonField* fields, size_t numFields) {
+                doJsonCallback(state, callback.get(), fields, numFields);
+            });
+        } else {
+            installCallback(session, &WebSocketSession::mJsonCallback, nullptr);
+            state->releaseCallback(callbackObject);
+        }
+    } else {
+        return returnSessionNotFound(state, uuid, callbackObject, outParam);
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionMessageBatching(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 4) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    auto maxMessages = std::max(0, inParams[1].data.i32);
+    auto maxBytes = std::max(0, inParams[2].data.i32);
+    auto maxLatency = std::chrono::microseconds(std::max(0, inParams[3].data.i32));
+    if (auto session = findSession(state, uuid)) {
+        session->setMessageBatching(maxMessages, maxBytes, maxLatency);
+    } else {
+        outParam->maybe_diagnostic = "Provided session handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionQueueLimits(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 7) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    if (auto session = findSession(state, uuid)) {
+        session->setQueueLimits(paramsToQueueLimits(inParams));
+    } else {
+        outParam->maybe_diagnostic = "Provided session handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionQueueStateCallback(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 1 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto uuid = inParams[0].data.i32;
+    if (auto session = findSession(state, uuid)) {
+        auto callback = retainCallback(state, callbackObject);
+        installCallback(session, &WebSocketSession::mQueueStateCallback, [=](bool isAboveHighWatermark) {
+            auto callbackData = sc_gluon_param_v1_t{
+                .data = { .boolean = isAboveHighWatermark },
+                .size = 1,
+                .tag = sc_gluon_bool,
+                .owns_data = false,
+            };
+            state->doCallback(callback.get(), &callbackData, 1);
+        });
+    } else {
+        return returnSessionNotFound(state, uuid, callbackObject, outParam);
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionCompressionStats(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 1 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto uuid = inParams[0].data.i32;
+    if (auto session = findSession(state, uuid)) {
+        doCompressionStatsCallback(state, callbackObject, session->getCompressionStats());
+        // the callback only gets called once
+        state->releaseCallback(callbackObject);
+    } else {
+        state->releaseCallback(callbackObject);
+        outParam->maybe_diagnostic = "Provided session handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionStats(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 1 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto uuid = inParams[0].data.i32;
+    if (auto session = findSession(state, uuid)) {
+        doStatsCallback(state, callbackObject, session->getStatsJson());
+        // the callback only gets called once
+        state->releaseCallback(callbackObject);
+    } else {
+        state->releaseCallback(callbackObject);
+        outParam->maybe_diagnostic = "Provided session handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionSubscribe(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 3) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    auto topic = std::string(inParams[1].data.character_array, inParams[1].size);
+    if (auto session = findSession(state, uuid)) {
+        session->setSubscribed(topic, inParams[2].data.boolean);
+    } else {
+        outParam->maybe_diagnostic = "Provided session handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionUdpRelay(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 4) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    auto const state = static_cast<WebSocketState*>(libraryData);
+
+    auto uuid = inParams[0].data.i32;
+    UdpRelayConfig config;
+    if (!paramsToUdpRelayConfig(inParams + 1, config)) {
+        outParam->maybe_diagnostic = "Invalid UDP relay address";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    if (auto session = findSession(state, uuid)) {
+        session->setUdpRelay(config);
+    } else {
+        outParam->maybe_diagnostic = "Provided session handle does not exist";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketSessionClose(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 1) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto const state = static_cast<WebSocketState*>(libraryData);
 
-    if (auto it = state->sessions.find(uuid); it != state->sessions.end()) {
-        auto session = it->second;
-
-        session->mMessageReceivedCallback = [=](WebSocketData& message) {
-            if (std::holds_alternative<std::string>(message)) {
-                auto stringMessage = std::get<std::string>(message);
-                auto callbackData = sc_gluon_param_v1_t{
-                    .data = { .character_array = stringMessage.data() },
-                    .size = static_cast<uint32_t>(stringMessage.size()),
-                    .tag = sc_gluon_char_array,
-                    .owns_data = false,
-                };
-                state->doCallback(callbackObject, &callbackData, 1);
-            } else {
-                auto bitMessage = std::get<std::vector<uint8_t>>(message);
-                auto callbackData = sc_gluon_param_v1_t{
-                    .data = { .u8_array = bitMessage.data() },
-                    .size = static_cast<uint32_t>(bitMessage.size()),
-                    .tag = sc_gluon_u8_array,
-                    .owns_data = false,
-                };
-                state->doCallback(callbackObject, &callbackData, 1);
-            }
-        };
+    auto uuid = inParams[0].data.i32;
+
+    if (auto session = findSession(state, uuid)) {
+
+        session->close();
     } else {
-        outParam->maybe_diagnostic = "Provided session uuid does not exist";
+        outParam->maybe_diagnostic = "Provided session handle does not exist";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
 
     return returnTrue(outParam);
 }
 
-sc_gluon_out_param_tag_v1 webSocketSessionClose(
+sc_gluon_out_param_tag_v1 webSocketIoThreads(
     sc_gluon_library_data_v1_t libraryData,
     sc_gluon_callable_object_v1_t callbackObject,
     sc_gluon_param_v1_t* inParams,
@@ -438,55 +1982,281 @@ sc_gluon_out_param_tag_v1 webSocketSessionClose(
 
     auto const state = static_cast<WebSocketState*>(libraryData);
 
-    auto uuid = inParams[0].data.i32;
+    auto numThreads = inParams[0].data.i32;
+    if (numThreads < static_cast<int>(state->threads.size())) {
+        // running handlers can not be moved to other threads, so the pool can only grow
+        outParam->maybe_diagnostic = "Number of IO threads can not be reduced while running";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+    try {
+        startIoThreads(state, clampIoThreads(numThreads));
+    } catch (const std::system_error&) {
+        // the threads which could be started keep running
+        outParam->maybe_diagnostic = "Could not start IO threads";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
 
-    if (auto it = state->sessions.find(uuid); it != state->sessions.end()) {
-        auto session = it->second;
+    return returnTrue(outParam);
+}
 
-        session->close();
-    } else {
-        outParam->maybe_diagnostic = "Provided session uuid does not exist";
+sc_gluon_out_param_tag_v1 webSocketHandleCounts(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 0 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    sc_gluon_param_v1_t callbackData[4];
+    uint32_t counts[4] = {
+        static_cast<uint32_t>(state->sessions.size()),
+        state->numRetiredSessions.load(),
+        static_cast<uint32_t>(state->clients.size()),
+        state->numRetiredClients.load(),
+    };
+    for (int i = 0; i < 4; i++) {
+        callbackData[i] = sc_gluon_param_v1_t{
+            .data = { .i32 = static_cast<int32_t>(counts[i]) },
+            .size = 1,
+            .tag = sc_gluon_i32,
+            .owns_data = false,
+        };
+    }
+    state->doCallback(callbackObject, callbackData, 4);
+    // the callback only gets called once
+    state->releaseCallback(callbackObject);
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketTraceLevel(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    if (numInParams != 1) {
+        outParam->maybe_diagnostic = "Wrong number of arguments";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto level = std::clamp(inParams[0].data.i32, 0, static_cast<int32_t>(TraceLevel::debug));
+    setTraceLevel(static_cast<TraceLevel>(level));
+
+    return returnTrue(outParam);
+}
+
+sc_gluon_out_param_tag_v1 webSocketTraceDump(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 0 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
         return sc_gluon_error_with_non_owned_diagnostic;
     }
 
+    doStatsCallback(state, callbackObject, traceDump());
+    // the callback only gets called once
+    state->releaseCallback(callbackObject);
+
     return returnTrue(outParam);
 }
 
+sc_gluon_out_param_tag_v1 webSocketTraceStream(
+    sc_gluon_library_data_v1_t libraryData,
+    sc_gluon_callable_object_v1_t callbackObject,
+    sc_gluon_param_v1_t* inParams,
+    uint32_t numInParams,
+    sc_gluon_out_param_or_maybe_diagnostic_v1* outParam
+) {
+    auto const state = static_cast<WebSocketState*>(libraryData);
+    if (numInParams != 1 || callbackObject == nullptr) {
+        if (callbackObject != nullptr) {
+            state->releaseCallback(callbackObject);
+        }
+        outParam->maybe_diagnostic = "Wrong number of arguments or missing callback";
+        return sc_gluon_error_with_non_owned_diagnostic;
+    }
+
+    auto interval = std::chrono::milliseconds(std::max(0, inParams[0].data.i32));
+    if (interval.count() > 0) {
+        auto callback = retainCallback(state, callbackObject);
+        boost::asio::dispatch(state->traceStrand, [=]() {
+            // the timer only runs on the trace strand, so there is a single drain at a time
+            state->traceTimer.start(interval, [=]() {
+                auto text = traceDrain();
+                if (!text.empty()) {
+                    doStatsCallback(state, callback.get(), text);
+                }
+            }, nullptr);
+        });
+    } else {
+        boost::asio::dispatch(state->traceStrand, [state]() { state->traceTimer.stop(); });
+        state->releaseCallback(callbackObject);
+    }
+
+    return returnTrue(outParam);
+}
 
 void setupDeclarations() {
+    // the library can get loaded again after it has been unloaded
+    gDeclarations->clear();
+
     // client declarations
     gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
         .name = "clientInit",
         .ptr=webSocketClientInit,
-        .num_parms = 3,  // uuid, host, port
+        .num_parms = 2,  // host, port - returns the handle of the client
         .accepts_callback = false,
     });
 
     gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
         .name = "clientConnect",
         .ptr = webSocketClientConnect,
-        .num_parms = 1, // uuid
+        .num_parms = 1, // handle
         .accepts_callback = true,
     });
 
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "clientReconnect",
+        .ptr = webSocketClientReconnect,
+        // handle, enabled, initial delay in ms, max delay in ms, multiplier, jitter, max attempts, max held messages
+        .num_parms = 8,
+        .accepts_callback = false,
+    });
+
     gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
         .name = "clientMessageReceivedCallback",
         .ptr = webSocketClientRegisterMessageCallback,
-        .num_parms = 1, // uuid
+        .num_parms = 1, // handle
+        .accepts_callback = true,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "clientOSCCallback",
+        .ptr = webSocketClientOscCallback,
+        .num_parms = 2, // handle, enabled
+        .accepts_callback = true,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "clientJSONCallback",
+        .ptr = webSocketClientJsonCallback,
+        .num_parms = 3, // handle, enabled, pointers
         .accepts_callback = true,
     });
 
     gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
         .name = "clientSendMessage",
         .ptr = webSocketClientSendMessage,
-        .num_parms = 3, // uuid, string/uint8 bool, data
+        .num_parms = 3, // handle, string/uint8 bool, data
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "clientSendKeyed",
+        .ptr = webSocketClientSendKeyed,
+        .num_parms = 4, // handle, key, string/uint8 bool, data
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "clientSendAt",
+        .ptr = webSocketClientSendAt,
+        .num_parms = 4, // handle, delay in microseconds, string/uint8 bool, data
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "clientSendBatch",
+        .ptr = webSocketClientSendBatch,
+        .num_parms = 2, // handle, packed messages
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "clientMessageBatching",
+        .ptr = webSocketClientMessageBatching,
+        .num_parms = 4, // handle, max messages, max bytes, max latency in us
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "clientQueueLimits",
+        .ptr = webSocketClientQueueLimits,
+        .num_parms = 7, // handle, max messages, max bytes, policy, high watermark, low watermark, disconnect timeout in ms
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "clientQueueStateCallback",
+        .ptr = webSocketClientQueueStateCallback,
+        .num_parms = 1, // handle
+        .accepts_callback = true,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "clientCompression",
+        .ptr = webSocketClientCompression,
+        .num_parms = 7, // handle, enabled, server max window bits, client max window bits, no context takeover, level, min size
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "clientKeepAlive",
+        .ptr = webSocketClientKeepAlive,
+        .num_parms = 3, // handle, ping interval in ms, idle timeout in ms
         .accepts_callback = false,
     });
 
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "clientCompressionStats",
+        .ptr = webSocketClientCompressionStats,
+        .num_parms = 1, // handle
+        .accepts_callback = true,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "clientStats",
+        .ptr = webSocketClientStats,
+        .num_parms = 1,  // handle
+        .accepts_callback = true,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "clientStatsInterval",
+        .ptr = webSocketClientStatsInterval,
+        .num_parms = 2,  // handle, interval in ms
+        .accepts_callback = true,
+    });
+
     gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
         .name = "clientCloseConnection",
         .ptr = webSocketClientCloseConnection,
-        .num_parms = 1, // uuid
+        .num_parms = 1, // handle
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "clientFree",
+        .ptr = webSocketClientFree,
+        .num_parms = 1, // handle
         .accepts_callback = false,
     });
 
@@ -494,52 +2264,248 @@ void setupDeclarations() {
     gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
         .name = "listenerInit",
         .ptr=webSocketListenerInit,
-        .num_parms = 3,  // uuid, host, port
+        .num_parms = 2,  // host, port - returns the handle of the listener
         .accepts_callback = false,
     });
 
     gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
         .name = "listenerStartStop",
         .ptr=webSocketListenerStartStop,
-        .num_parms = 2,  // uuid, start/stop bool
+        .num_parms = 2,  // handle, start/stop bool
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "listenerCompression",
+        .ptr=webSocketListenerCompression,
+        .num_parms = 7,  // handle, enabled, server max window bits, client max window bits, no context takeover, level, min size
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "listenerKeepAlive",
+        .ptr = webSocketListenerKeepAlive,
+        .num_parms = 3,  // handle, ping interval in ms, idle timeout in ms
         .accepts_callback = false,
     });
 
     gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
         .name = "listenerNewConnectionCallback",
         .ptr=webSocketListenerNewConnectionCallback,
-        .num_parms = 1,  // uuid
+        .num_parms = 1,  // handle
+        .accepts_callback = true,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "listenerSessionRetiredCallback",
+        .ptr=webSocketListenerSessionRetiredCallback,
+        .num_parms = 1,  // handle
+        .accepts_callback = true,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "listenerStats",
+        .ptr = webSocketListenerStats,
+        .num_parms = 1,  // handle
+        .accepts_callback = true,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "listenerStatsInterval",
+        .ptr = webSocketListenerStatsInterval,
+        .num_parms = 2,  // handle, interval in ms
         .accepts_callback = true,
     });
 
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "listenerBroadcast",
+        .ptr=webSocketListenerBroadcast,
+        .num_parms = 3,  // handle, message kind bool, message data
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "listenerTopicControlFrames",
+        .ptr=webSocketListenerTopicControlFrames,
+        .num_parms = 2,  // handle, enabled
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "listenerUdpRelay",
+        .ptr=webSocketListenerUdpRelay,
+        .num_parms = 4,  // handle, host, port, mirror prefixes
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "listenerPublish",
+        .ptr=webSocketListenerPublish,
+        .num_parms = 4,  // handle, topic, message kind bool, message data
+        .accepts_callback = false,
+    });
+
     gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
         .name = "sessionSendMessage",
         .ptr=webSocketSessionSendMessage,
-        .num_parms = 3,  // uuid, message kind bool, message data
+        .num_parms = 3,  // handle, message kind bool, message data
+        .accepts_callback = false,
+    });
+
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "sessionSendKeyed",
+        .ptr=webSocketSessionSendKeyed,
+        .num_parms = 4,  // handle, key, message kind bool, message data
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "sessionSendAt",
+        .ptr=webSocketSessionSendAt,
+        .num_parms = 4,  // handle, delay in microseconds, message kind bool, message data
         .accepts_callback = false,
     });
 
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "sessionSendBatch",
+        .ptr=webSocketSessionSendBatch,
+        .num_parms = 2,  // handle, packed messages
+        .accepts_callback = false,
+    });
 
     gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
         .name = "sessionConnectionStateCallback",
         .ptr=webSocketSessionConnectionStateCallback,
-        .num_parms = 1,  // uuid
+        .num_parms = 1,  // handle
         .accepts_callback = true,
     });
 
     gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
         .name = "sessionMessageCallback",
         .ptr=webSocketSessionMessageCallback,
-        .num_parms = 1,  // uuid
+        .num_parms = 1,  // handle
+        .accepts_callback = true,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "sessionOSCCallback",
+        .ptr=webSocketSessionOscCallback,
+        .num_parms = 2,  // handle, enabled
+        .accepts_callback = true,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "sessionJSONCallback",
+        .ptr=webSocketSessionJsonCallback,
+        .num_parms = 3,  // handle, enabled, pointers
+        .accepts_callback = true,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "sessionMessageBatching",
+        .ptr=webSocketSessionMessageBatching,
+        .num_parms = 4,  // handle, max messages, max bytes, max latency in us
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "sessionQueueLimits",
+        .ptr=webSocketSessionQueueLimits,
+        .num_parms = 7,  // handle, max messages, max bytes, policy, high watermark, low watermark, disconnect timeout in ms
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "sessionQueueStateCallback",
+        .ptr=webSocketSessionQueueStateCallback,
+        .num_parms = 1,  // handle
+        .accepts_callback = true,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "sessionCompressionStats",
+        .ptr=webSocketSessionCompressionStats,
+        .num_parms = 1,  // handle
+        .accepts_callback = true,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "sessionStats",
+        .ptr = webSocketSessionStats,
+        .num_parms = 1,  // handle
         .accepts_callback = true,
     });
 
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "sessionSubscribe",
+        .ptr=webSocketSessionSubscribe,
+        .num_parms = 3,  // handle, topic, subscribed
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "sessionUdpRelay",
+        .ptr=webSocketSessionUdpRelay,
+        .num_parms = 4,  // handle, host, port, mirror prefixes
+        .accepts_callback = false,
+    });
+
     gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
         .name = "sessionClose",
         .ptr=webSocketSessionClose,
-        .num_parms = 1,  // uuid
+        .num_parms = 1,  // handle
+        .accepts_callback = false,
+    });
+
+    // library declarations
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "ioThreads",
+        .ptr=webSocketIoThreads,
+        .num_parms = 1,  // number of io threads
+        .accepts_callback = false,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "handleCounts",
+        .ptr=webSocketHandleCounts,
+        .num_parms = 0,
+        .accepts_callback = true,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "traceLevel",
+        .ptr = webSocketTraceLevel,
+        .num_parms = 1,  // 0 off, 1 error, 2 info, 3 debug
         .accepts_callback = false,
     });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "traceDump",
+        .ptr = webSocketTraceDump,
+        .num_parms = 0,
+        .accepts_callback = true,
+    });
+
+    gDeclarations->push_back(sc_gluon_function_declarations_v1_t {
+        .name = "traceStream",
+        .ptr = webSocketTraceStream,
+        .num_parms = 1,  // interval in ms
+        .accepts_callback = true,
+    });
+}
+
+// all threads run the same io context. Every connection has its own strand,
+// so handlers of a connection never run concurrently while different
+// connections can be served in parallel.
+void startIoThreads(WebSocketState* state, size_t numThreads) {
+    while (state->threads.size() < numThreads) {
+        state->threads.emplace_back([=, index = static_cast<int32_t>(state->threads.size())]() {
+            trace(TraceEvent::ioThreadStarted, index);
+            state->ioContext.run();
+            trace(TraceEvent::ioThreadStopped, index);
+        });
+    }
 }
 
 void setupIoContext(WebSocketState* state) {
@@ -547,16 +2513,13 @@ void setupIoContext(WebSocketState* state) {
         boost::asio::make_work_guard(state->ioContext)
     );
 
-    state->thread = std::thread([=]() {
-#ifdef SC_WEBSOCKET_DEBUG
-        std::cout << "Start WebSocket thread" << std::endl;
-#endif
-
-        state->ioContext.run();
-#ifdef SC_WEBSOCKET_DEBUG
-        std::cout << "IO context stopped" << std::endl;
-#endif
-    });
+    // the number of threads can be set at load time via an environment variable
+    // and increased later on via `ioThreads`
+    size_t numThreads = 1;
+    if (auto envThreads = std::getenv("SC_WEBSOCKET_IO_THREADS")) {
+        numThreads = clampIoThreads(std::atoi(envThreads));
+    }
+    startIoThreads(state, numThreads);
 }
 
 extern "C" {
@@ -584,7 +2547,7 @@ sc_gluon_library_data_v1_t sc_gluon_load_library(
 }
 
 void sc_gluon_unload_library(sc_gluon_library_data_v1_t data) {
-    std::cout << "sc_gluon_unload_library" << std::endl;
+    trace(TraceEvent::libraryUnloaded, 0);
 
     auto state = reinterpret_cast<WebSocketState*>(data);
 
@@ -594,11 +2557,14 @@ void sc_gluon_unload_library(sc_gluon_library_data_v1_t data) {
     }
 
     state->ioContext.stop();
-    if (state->thread.joinable()) {
-        state->thread.join();
+    for (auto& thread : state->threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
     }
     state->ioContext.reset();
 
-    std::destroy_at(&state);
+    // releases the remaining clients, listeners and sessions and thereby their callback objects
+    delete state;
 }
 }
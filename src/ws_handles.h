@@ -0,0 +1,166 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+/** Maps handles which can be passed to sclang onto shared objects.
+A handle consists of the index of its slot and the generation of the slot,
+which gets increased when an object gets erased, so a stale handle does not
+find the object which reuses its slot. Freed slots get reused in the order
+they were freed, and a slot whose generation would wrap around gets retired,
+so a handle can never match a later object.
+Slots are allocated in chunks which never move, so a lookup does not take the
+table mutex: it holds a per-slot spin lock while copying the shared pointer,
+so it only contends with other lookups and erasures of the same slot.
+*/
+template <class T>
+class HandleTable {
+public:
+    using Handle = int32_t;
+
+    static constexpr Handle kInvalidHandle = -1;
+
+    HandleTable() {
+        for (auto& chunk : mChunks) {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~HandleTable() {
+        for (auto& chunk : mChunks) {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    HandleTable(const HandleTable&) = delete;
+    HandleTable& operator=(const HandleTable&) = delete;
+
+    // returns `kInvalidHandle` if all slots are in use or retired
+    Handle insert(std::shared_ptr<T> value) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        uint32_t index;
+        if (!mFreeIndices.empty()) {
+            index = mFreeIndices.front();
+            mFreeIndices.pop_front();
+        } else if (mNumSlots < kMaxSlots) {
+            index = mNumSlots++;
+            auto& chunk = mChunks[index >> kChunkBits];
+            if (chunk.load(std::memory_order_relaxed) == nullptr) {
+                chunk.store(new Slot[kChunkSize], std::memory_order_release);
+            }
+        } else {
+            return kInvalidHandle;
+        }
+        auto& slot = slotAt(index);
+        SlotLock slotLock(slot);
+        slot.value = std::move(value);
+        mSize.fetch_add(1, std::memory_order_relaxed);
+        return static_cast<Handle>((slot.generation.load(std::memory_order_relaxed) << kIndexBits) | index);
+    }
+
+    // can be called from any thread - returns a nullptr for stale or invalid handles
+    std::shared_ptr<T> find(Handle handle) const {
+        auto slot = findSlot(handle);
+        if (slot == nullptr) {
+            return nullptr;
+        }
+        SlotLock slotLock(*slot);
+        if (slot->generation.load(std::memory_order_relaxed) != generationOf(handle)) {
+            return nullptr;
+        }
+        return slot->value;
+    }
+
+    // returns true if the handle belonged to an object which has been erased since
+    bool isStale(Handle handle) const {
+        auto slot = findSlot(handle);
+        return slot != nullptr && slot->generation.load(std::memory_order_acquire) != generationOf(handle);
+    }
+
+    // returns false if the handle is stale or invalid
+    bool erase(Handle handle) {
+        std::shared_ptr<T> value;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto slot = findSlot(handle);
+            if (slot == nullptr) {
+                return false;
+            }
+            {
+                SlotLock slotLock(*slot);
+                if (slot->generation.load(std::memory_order_relaxed) != generationOf(handle) || !slot->value) {
+                    return false;
+                }
+                value = std::move(slot->value);
+                slot->value = nullptr;
+                slot->generation.store((generationOf(handle) + 1) & kGenerationMask, std::memory_order_release);
+            }
+            if (generationOf(handle) < kGenerationMask) {
+                mFreeIndices.push_back(handle & kIndexMask);
+            }
+            mSize.fetch_sub(1, std::memory_order_relaxed);
+        }
+        // the object may get destroyed here, which must not happen while holding a lock
+        return true;
+    }
+
+    size_t size() const { return mSize.load(std::memory_order_relaxed); }
+
+private:
+    // handles have to be positive 32 bit integers, which leaves 11 bits for the generation
+    static constexpr int kIndexBits = 20;
+    static constexpr int kChunkBits = 10;
+    static constexpr uint32_t kMaxSlots = 1 << kIndexBits;
+    static constexpr uint32_t kChunkSize = 1 << kChunkBits;
+    static constexpr uint32_t kIndexMask = kMaxSlots - 1;
+    static constexpr uint32_t kGenerationMask = (1 << (31 - kIndexBits)) - 1;
+
+    struct Slot {
+        std::atomic<uint32_t> generation = 0;
+        std::atomic_flag lock = ATOMIC_FLAG_INIT;
+        std::shared_ptr<T> value;
+    };
+
+    // the slot lock only gets held while copying the shared pointer
+    class SlotLock {
+    public:
+        explicit SlotLock(Slot& slot): mSlot(slot) {
+            while (mSlot.lock.test_and_set(std::memory_order_acquire)) {
+            }
+        }
+
+        ~SlotLock() { mSlot.lock.clear(std::memory_order_release); }
+
+    private:
+        Slot& mSlot;
+    };
+
+    static uint32_t generationOf(Handle handle) { return static_cast<uint32_t>(handle) >> kIndexBits; }
+
+    Slot& slotAt(uint32_t index) const {
+        return mChunks[index >> kChunkBits].load(std::memory_order_acquire)[index & (kChunkSize - 1)];
+    }
+
+    Slot* findSlot(Handle handle) const {
+        if (handle < 0) {
+            return nullptr;
+        }
+        auto index = static_cast<uint32_t>(handle) & kIndexMask;
+        auto chunk = mChunks[index >> kChunkBits].load(std::memory_order_acquire);
+        if (chunk == nullptr) {
+            return nullptr;
+        }
+        return &chunk[index & (kChunkSize - 1)];
+    }
+
+    std::array<std::atomic<Slot*>, (kMaxSlots >> kChunkBits)> mChunks;
+    // guards insertion and erasure
+    std::mutex mMutex;
+    std::deque<uint32_t> mFreeIndices;
+    uint32_t mNumSlots = 0;
+    std::atomic<size_t> mSize = 0;
+};
@@ -0,0 +1,123 @@
+#include "ws_json.h"
+
+#include <algorithm>
+
+// Boost.JSON gets compiled as part of this library
+#include <boost/json/src.hpp>
+
+namespace {
+
+// escapes a key as a reference token of a JSON pointer
+void appendToken(std::string& pointer, std::string_view token) {
+    pointer.push_back('/');
+    for (auto c : token) {
+        if (c == '~') {
+            pointer.append("~0");
+        } else if (c == '/') {
+            pointer.append("~1");
+        } else {
+            pointer.push_back(c);
+        }
+    }
+}
+
+}
+
+void* JsonDecoder::OverflowResource::do_allocate(size_t size, size_t alignment) {
+    numBytes += size;
+    return boost::json::storage_ptr()->allocate(size, alignment);
+}
+
+void JsonDecoder::OverflowResource::do_deallocate(void* data, size_t size, size_t alignment) {
+    boost::json::storage_ptr()->deallocate(data, size, alignment);
+}
+
+JsonDecoder::JsonDecoder(): mBuffer(4096) {}
+
+void JsonDecoder::setPointers(std::vector<std::string> pointers) { mPointers = std::move(pointers); }
+
+bool JsonDecoder::parse(const char* data, size_t size, const FieldCallback& callback) {
+    boost::system::error_code ec;
+    // the blocks which did not fit into the buffer get freed with the resource
+    boost::json::monotonic_resource resource(mBuffer.data(), mBuffer.size(), boost::json::storage_ptr(&mOverflow));
+    mParser.reset(boost::json::storage_ptr(&resource));
+    mParser.write(data, size, ec);
+    if (!ec) {
+        mParser.finish(ec);
+    }
+    if (ec) {
+        mParser.reset();
+        growBuffer();
+        return false;
+    }
+
+    {
+        // values allocated by a monotonic resource do not need to be destroyed
+        // before releasing the resource, but keep the order clean anyway
+        auto document = mParser.release();
+        mPointerData.clear();
+        mPointerRanges.clear();
+        mValues.clear();
+        if (mPointers.empty()) {
+            mPointer.clear();
+            flatten(document);
+        } else {
+            for (const auto& pointer : mPointers) {
+                boost::system::error_code pointerEc;
+                if (auto value = document.find_pointer(pointer, pointerEc)) {
+                    mPointer = pointer;
+                    flatten(*value);
+                }
+            }
+        }
+
+        mFields.clear();
+        for (size_t i = 0; i < mValues.size(); i++) {
+            auto [offset, length] = mPointerRanges[i];
+            mFields.push_back(JsonField {
+                .pointer = std::string_view(mPointerData).substr(offset, length),
+                .value = mValues[i],
+            });
+        }
+        if (callback) {
+            callback(mFields.data(), mFields.size());
+        }
+    }
+    mParser.reset();
+    growBuffer();
+    return true;
+}
+
+void JsonDecoder::growBuffer() {
+    if (mOverflow.numBytes > 0 && mBuffer.size() < kMaxBufferSize) {
+        mBuffer.resize(std::min(mBuffer.size() + mOverflow.numBytes, kMaxBufferSize));
+    }
+    mOverflow.numBytes = 0;
+}
+
+void JsonDecoder::flatten(const boost::json::value& value) {
+    if (auto object = value.if_object(); object && !object->empty()) {
+        auto pointerSize = mPointer.size();
+        for (const auto& member : *object) {
+            appendToken(mPointer, member.key());
+            flatten(member.value());
+            mPointer.resize(pointerSize);
+        }
+    } else if (auto array = value.if_array(); array && !array->empty()) {
+        auto pointerSize = mPointer.size();
+        for (size_t i = 0; i < array->size(); i++) {
+            appendToken(mPointer, std::to_string(i));
+            flatten((*array)[i]);
+            mPointer.resize(pointerSize);
+        }
+    } else {
+        addField(value);
+    }
+}
+
+void JsonDecoder::addField(const boost::json::value& value) {
+    // string views into `mPointerData` get created after it has stopped growing
+    mPointerRanges.emplace_back(mPointerData.size(), mPointer.size());
+    mPointerData.append(mPointer);
+    mValues.push_back(&value);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/container/pmr/memory_resource.hpp>
+#include <boost/json/monotonic_resource.hpp>
+#include <boost/json/stream_parser.hpp>
+#include <boost/json/value.hpp>
+
+// a leaf of a decoded JSON document, only valid during the callback it gets passed into
+struct JsonField {
+    // RFC 6901 pointer to the value, e.g. "/user/name"
+    std::string_view pointer;
+    // a scalar, an empty object or an empty array
+    const boost::json::value* value;
+};
+
+/** Decodes JSON text messages into a flat list of pointer/value pairs.
+Each message gets parsed into a monotonic resource on top of a buffer which grows
+by what did not fit into it, so decoding does not allocate once the buffers have
+grown to the size of the received messages. The buffer grows up to `kMaxBufferSize`,
+larger documents allocate on every message. If pointers are set, only the values
+below these pointers get passed on. The decoder keeps its buffers between
+calls, so a connection should own its decoder.
+*/
+class JsonDecoder {
+public:
+    using FieldCallback = std::function<void(const JsonField* fields, size_t numFields)>;
+
+    JsonDecoder();
+
+    // an empty list passes on the whole document
+    void setPointers(std::vector<std::string> pointers);
+
+    // returns false if the data is not valid JSON - the callback does not get called in this case
+    bool parse(const char* data, size_t size, const FieldCallback& callback);
+
+private:
+    void flatten(const boost::json::value& value);
+
+    void addField(const boost::json::value& value);
+
+    // lets the next message fit into the buffer if this one did not
+    void growBuffer();
+
+    // forwards to the default resource and counts the bytes which did not fit into the buffer
+    class OverflowResource final : public boost::container::pmr::memory_resource {
+    public:
+        size_t numBytes = 0;
+
+    private:
+        void* do_allocate(size_t size, size_t alignment) override;
+
+        void do_deallocate(void* data, size_t size, size_t alignment) override;
+
+        bool do_is_equal(const boost::container::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    static constexpr size_t kMaxBufferSize = 1 << 20;
+
+    std::vector<std::string> mPointers;
+    // memory of the monotonic resource of a message, larger messages allocate additional blocks
+    std::vector<unsigned char> mBuffer;
+    OverflowResource mOverflow;
+    boost::json::stream_parser mParser;
+    // the pointer of the value which gets flattened, fields point into `mPointerData`
+    std::string mPointer;
+    std::string mPointerData;
+    std::vector<std::pair<size_t, size_t>> mPointerRanges;
+    std::vector<const boost::json::value*> mValues;
+    std::vector<JsonField> mFields;
+};
@@ -0,0 +1,72 @@
+#include "ws_memory.h"
+
+#include <new>
+
+BufferPool& BufferPool::instance() {
+    // never gets destroyed, so payloads which get released during shutdown can still be returned
+    static auto* pool = new BufferPool();
+    return *pool;
+}
+
+BufferPool::BufferPool() {
+    for (size_t i = 0; i < kNumSizeClasses; i++) {
+        // reserve upfront, so returning a block never allocates
+        mSizeClasses[i].freeBlocks.reserve(kMaxPooledBytesPerClass / (kMinBlockSize << i));
+    }
+}
+
+void* BufferPool::allocate(size_t size, uint8_t& sizeClass) {
+    uint8_t index = 0;
+    while (index < kNumSizeClasses && (kMinBlockSize << index) < size) {
+        index++;
+    }
+    if (index == kNumSizeClasses) {
+        sizeClass = kUnpooled;
+        return ::operator new(size);
+    }
+    sizeClass = index;
+    auto& pool = mSizeClasses[index];
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (!pool.freeBlocks.empty()) {
+            auto memory = pool.freeBlocks.back();
+            pool.freeBlocks.pop_back();
+            return memory;
+        }
+    }
+    return ::operator new(kMinBlockSize << index);
+}
+
+void BufferPool::deallocate(void* memory, uint8_t sizeClass) {
+    if (sizeClass != kUnpooled) {
+        auto& pool = mSizeClasses[sizeClass];
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (pool.freeBlocks.size() < pool.freeBlocks.capacity()) {
+            pool.freeBlocks.push_back(memory);
+            return;
+        }
+    }
+    ::operator delete(memory);
+}
+
+void* HandlerMemory::allocate(size_t size) {
+    if (size <= kSlotSize) {
+        for (auto& slot : mSlots) {
+            if (!slot.inUse.exchange(true, std::memory_order_acquire)) {
+                return slot.storage;
+            }
+        }
+    }
+    mNumHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(size);
+}
+
+void HandlerMemory::deallocate(void* pointer) {
+    for (auto& slot : mSlots) {
+        if (pointer == slot.storage) {
+            slot.inUse.store(false, std::memory_order_release);
+            return;
+        }
+    }
+    ::operator delete(pointer);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/bind_allocator.hpp>
+
+/** Recycles the memory of message payloads in power of two size classes.
+Sending and receiving messages of similar sizes therefore does not allocate
+once the pool has warmed up. Larger allocations bypass the pool.
+*/
+class BufferPool {
+public:
+    static constexpr uint8_t kUnpooled = 0xFF;
+
+    static BufferPool& instance();
+
+    // returns memory of at least `size` bytes and its size class, which has to be passed to `deallocate`
+    void* allocate(size_t size, uint8_t& sizeClass);
+
+    void deallocate(void* memory, uint8_t sizeClass);
+
+private:
+    static constexpr size_t kMinBlockSize = 64;
+    static constexpr size_t kNumSizeClasses = 11;  // up to 64 kB
+    // upper bound of the memory each size class keeps for reuse
+    static constexpr size_t kMaxPooledBytesPerClass = 4 * 1024 * 1024;
+
+    struct SizeClass {
+        std::mutex mutex;
+        std::vector<void*> freeBlocks;
+    };
+
+    BufferPool();
+
+    std::array<SizeClass, kNumSizeClasses> mSizeClasses;
+};
+
+/** Memory for the handlers of an asynchronous loop of a connection, e.g. `doRead` -> `onRead`.
+Each asynchronous operation of such a loop allocates its state through the
+allocator associated with its completion handler, see `bindHandlerMemory`.
+As a loop only has a few operations in flight at any time, a few fixed
+slots suffice to avoid allocations - further allocations fall back to the heap.
+Slots can be released from any io thread.
+*/
+class HandlerMemory {
+public:
+    HandlerMemory() = default;
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void* allocate(size_t size);
+
+    void deallocate(void* pointer);
+
+    // number of allocations which did not fit into a slot
+    uint64_t numHeapAllocations() const { return mNumHeapAllocations.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t kNumSlots = 4;
+    static constexpr size_t kSlotSize = 2048;
+
+    struct Slot {
+        alignas(std::max_align_t) unsigned char storage[kSlotSize];
+        std::atomic<bool> inUse = false;
+    };
+
+    std::array<Slot, kNumSlots> mSlots;
+    std::atomic<uint64_t> mNumHeapAllocations = 0;
+};
+
+// standard allocator which allocates from a `HandlerMemory`
+template <class T>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory& memory): mMemory(&memory) {}
+
+    template <class U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept: mMemory(other.mMemory) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(mMemory->allocate(sizeof(T) * n)); }
+
+    void deallocate(T* pointer, size_t) { mMemory->deallocate(pointer); }
+
+    template <class U>
+    bool operator==(const HandlerAllocator<U>& other) const noexcept {
+        return mMemory == other.mMemory;
+    }
+
+    template <class U>
+    bool operator!=(const HandlerAllocator<U>& other) const noexcept {
+        return mMemory != other.mMemory;
+    }
+
+private:
+    template <class U>
+    friend class HandlerAllocator;
+
+    HandlerMemory* mMemory;
+};
+
+// associates the handler memory with a completion handler - the memory has to outlive the operation
+template <class Handler>
+auto bindHandlerMemory(HandlerMemory& memory, Handler&& handler) {
+    return boost::asio::bind_allocator(HandlerAllocator<char>(memory), std::forward<Handler>(handler));
+}
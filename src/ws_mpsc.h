@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+/** Bounded lock-free queue for multiple producers and a single consumer.
+Pushing neither allocates nor blocks, so it can be used from the sclang thread
+to hand messages over to an io thread. Every cell carries a sequence number
+which tells producers and the consumer whether the cell is free or filled,
+see https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+*/
+template <class T>
+class MpscRing {
+public:
+    // the capacity gets rounded up to a power of two
+    explicit MpscRing(size_t capacity) {
+        mCapacity = 1;
+        while (mCapacity < capacity) {
+            mCapacity <<= 1;
+        }
+        mCells = std::make_unique<Cell[]>(mCapacity);
+        for (size_t i = 0; i < mCapacity; i++) {
+            mCells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // can be called from any thread - returns false if the ring is full, in which case value is left untouched
+    bool push(T& value) {
+        auto position = mPushPosition.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &mCells[position & (mCapacity - 1)];
+            auto sequence = cell->sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (difference == 0) {
+                if (mPushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = mPushPosition.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // must only be called from the consumer - returns false if the ring is empty
+    bool pop(T& value) {
+        auto& cell = mCells[mPopPosition & (mCapacity - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != mPopPosition + 1) {
+            return false;
+        }
+        value = std::move(cell.value);
+        cell.sequence.store(mPopPosition + mCapacity, std::memory_order_release);
+        mPopPosition++;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    size_t mCapacity;
+    std::unique_ptr<Cell[]> mCells;
+    // producers and the consumer should not share a cache line
+    alignas(64) std::atomic<size_t> mPushPosition = 0;
+    alignas(64) size_t mPopPosition = 0;
+};
+
+/** Hands messages over from other threads to the strand of a connection.
+Messages get pushed into a ring and the strand gets woken up once per burst
+instead of once per message. Operations which can not go through the ring,
+e.g. keyed sends, bypass it - while such a bypass is pending, all pushes bypass
+the ring, so messages of a thread keep their order.
+A full ring means the strand is behind, in which case a producer can wait for
+it via `pushWaiting` instead of bypassing the ring.
+*/
+template <class T>
+class SubmissionQueue {
+public:
+    explicit SubmissionQueue(size_t capacity = 1024): mRing(capacity) {}
+
+    // a producer waits at most this long for the strand, in case it is blocked
+    static constexpr std::chrono::milliseconds kMaxWait { 100 };
+
+    // returns false if the value has to bypass the ring or the ring is full,
+    // in which case it is left untouched
+    bool push(T& value) {
+        if (isBypassing()) {
+            return false;
+        }
+        return mRing.push(value);
+    }
+
+    // waits for the consumer to make room in a full ring - returns false if a bypass began
+    // or the ring is still full after `kMaxWait`. Must not be called from the consumer.
+    bool pushWaiting(T& value) {
+        auto deadline = std::chrono::steady_clock::now() + kMaxWait;
+        do {
+            std::this_thread::yield();
+            if (isBypassing()) {
+                return false;
+            }
+            if (mRing.push(value)) {
+                return true;
+            }
+        } while (std::chrono::steady_clock::now() < deadline);
+        return false;
+    }
+
+    bool isBypassing() const { return mNumPendingBypasses.load(std::memory_order_acquire) > 0; }
+
+    // returns true if the caller has to schedule a drain after a successful push
+    bool needsWakeup() { return !mDrainScheduled.exchange(true, std::memory_order_acq_rel); }
+
+    void beginBypass() { mNumPendingBypasses.fetch_add(1, std::memory_order_acq_rel); }
+
+    void endBypass() { mNumPendingBypasses.fetch_sub(1, std::memory_order_acq_rel); }
+
+    // must only be called from the strand
+    template <class Consumer>
+    void drain(Consumer&& consumer) {
+        // pushes from here on schedule a new drain
+        mDrainScheduled.store(false, std::memory_order_release);
+        T value;
+        while (mRing.pop(value)) {
+            consumer(std::move(value));
+        }
+    }
+
+private:
+    MpscRing<T> mRing;
+    std::atomic<bool> mDrainScheduled = false;
+    std::atomic<int> mNumPendingBypasses = 0;
+};
@@ -0,0 +1,189 @@
+#include "ws_osc.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+constexpr char kBundleHeader[] = "#bundle";
+// seconds between the NTP epoch (1900) and the unix epoch (1970)
+constexpr uint64_t kNtpUnixOffset = 2208988800ULL;
+
+uint32_t readU32(const uint8_t* data) {
+    return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+}
+
+uint64_t readU64(const uint8_t* data) { return (uint64_t(readU32(data)) << 32) | readU32(data + 4); }
+
+size_t padded(size_t size) { return (size + 3) & ~size_t(3); }
+
+// reads a null terminated string which is padded to 4 bytes, returns false if it is not terminated
+bool readString(uint8_t* data, size_t size, size_t& offset, uint8_t*& outString, size_t& outSize) {
+    auto start = data + offset;
+    auto end = static_cast<uint8_t*>(std::memchr(start, 0, size - offset));
+    if (end == nullptr) {
+        return false;
+    }
+    outString = start;
+    outSize = end - start;
+    offset += padded(outSize + 1);
+    return offset <= size;
+}
+
+}
+
+bool OscParser::parse(uint8_t* data, size_t size, const MessageCallback& callback) {
+    // validate first, so a malformed packet does not get delivered partially
+    if (!parsePacket(data, size, kOscTimetagImmediately, 0, nullptr)) {
+        return false;
+    }
+    return parsePacket(data, size, kOscTimetagImmediately, 0, &callback);
+}
+
+bool OscParser::parsePacket(uint8_t* data, size_t size, uint64_t timetag, int depth,
+                            const MessageCallback* callback) {
+    if (size == 0 || size % 4 != 0) {
+        return false;
+    }
+    if (data[0] == '/') {
+        return parseMessage(data, size, timetag, callback);
+    }
+    if (size < 16 || std::memcmp(data, kBundleHeader, sizeof(kBundleHeader)) != 0 || depth >= kOscMaxBundleDepth) {
+        return false;
+    }
+    auto bundleTimetag = readU64(data + 8);
+    for (size_t offset = 16; offset < size;) {
+        if (size - offset < 4) {
+            return false;
+        }
+        auto elementSize = readU32(data + offset);
+        offset += 4;
+        if (elementSize > size - offset) {
+            return false;
+        }
+        if (!parsePacket(data + offset, elementSize, bundleTimetag, depth + 1, callback)) {
+            return false;
+        }
+        offset += elementSize;
+    }
+    return true;
+}
+
+bool OscParser::parseMessage(uint8_t* data, size_t size, uint64_t timetag, const MessageCallback* callback) {
+    size_t offset = 0;
+    uint8_t* address;
+    size_t addressSize;
+    if (!readString(data, size, offset, address, addressSize)) {
+        return false;
+    }
+
+    // a message without type tags has no arguments
+    uint8_t* typeTags = nullptr;
+    size_t numTypeTags = 0;
+    if (offset < size && data[offset] == ',') {
+        if (!readString(data, size, offset, typeTags, numTypeTags)) {
+            return false;
+        }
+        // skip the comma
+        typeTags++;
+        numTypeTags--;
+    }
+
+    mArguments.clear();
+    for (size_t i = 0; i < numTypeTags; i++) {
+        OscArgument argument {};
+        argument.type = static_cast<char>(typeTags[i]);
+        switch (argument.type) {
+        case 'i':
+        case 'c':
+        case 'r':
+        case 'm':
+            if (size - offset < 4) {
+                return false;
+            }
+            argument.i32 = static_cast<int32_t>(readU32(data + offset));
+            offset += 4;
+            break;
+        case 'f': {
+            if (size - offset < 4) {
+                return false;
+            }
+            auto bits = readU32(data + offset);
+            std::memcpy(&argument.f32, &bits, sizeof(float));
+            offset += 4;
+            break;
+        }
+        case 'h':
+            if (size - offset < 8) {
+                return false;
+            }
+            argument.i64 = static_cast<int64_t>(readU64(data + offset));
+            offset += 8;
+            break;
+        case 'd': {
+            if (size - offset < 8) {
+                return false;
+            }
+            auto bits = readU64(data + offset);
+            std::memcpy(&argument.f64, &bits, sizeof(double));
+            offset += 8;
+            break;
+        }
+        case 't':
+            if (size - offset < 8) {
+                return false;
+            }
+            argument.timetag = readU64(data + offset);
+            offset += 8;
+            break;
+        case 's':
+        case 'S':
+            if (!readString(data, size, offset, argument.data, argument.size)) {
+                return false;
+            }
+            break;
+        case 'b':
+            if (size - offset < 4) {
+                return false;
+            }
+            argument.size = readU32(data + offset);
+            offset += 4;
+            if (argument.size > size - offset || padded(argument.size) > size - offset) {
+                return false;
+            }
+            argument.data = data + offset;
+            offset += padded(argument.size);
+            break;
+        case 'T':
+        case 'F':
+        case 'N':
+        case 'I':
+            // these carry no data
+            break;
+        default:
+            return false;
+        }
+        mArguments.push_back(argument);
+    }
+
+    if (callback && *callback) {
+        (*callback)(OscMessageView {
+            .address = reinterpret_cast<char*>(address),
+            .addressSize = addressSize,
+            .arguments = mArguments.data(),
+            .numArguments = mArguments.size(),
+            .timetag = timetag,
+        });
+    }
+    return true;
+}
+
+double oscTimetagToDelay(uint64_t timetag) {
+    if (timetag == kOscTimetagImmediately) {
+        return 0.0;
+    }
+    auto seconds = static_cast<double>(timetag >> 32) - static_cast<double>(kNtpUnixOffset)
+        + static_cast<double>(timetag & 0xFFFFFFFF) / 4294967296.0;
+    auto now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    return seconds - now;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// OSC 1.0 decoding of binary websocket messages,
+// see https://opensoundcontrol.stanford.edu/spec-1_0.html
+
+// a timetag of 1 means the message should be processed immediately
+constexpr uint64_t kOscTimetagImmediately = 1;
+
+// bundles nested deeper than this get rejected, so a crafted packet can not exhaust the stack of an io thread
+constexpr int kOscMaxBundleDepth = 16;
+
+// a decoded argument - strings and blobs point into the received message
+struct OscArgument {
+    char type;
+    union {
+        int32_t i32;
+        float f32;
+        int64_t i64;
+        double f64;
+        uint64_t timetag;
+    };
+    // string (without the terminating null) or blob data
+    uint8_t* data;
+    size_t size;
+};
+
+// a decoded message which is only valid during the callback it gets passed into
+struct OscMessageView {
+    char* address;
+    size_t addressSize;
+    const OscArgument* arguments;
+    size_t numArguments;
+    // timetag of the enclosing bundle as NTP time
+    uint64_t timetag;
+};
+
+/** Decodes OSC packets without copying them.
+Bundles get flattened, so the callback gets called once for every message within
+the packet, in order. Packets with bundles nested deeper than `kOscMaxBundleDepth` are invalid. The parser keeps its argument buffer between calls, so a
+connection should own its parser.
+*/
+class OscParser {
+public:
+    using MessageCallback = std::function<void(const OscMessageView& message)>;
+
+    // returns false if the data is not a valid OSC packet - the callback does not get called in this case
+    bool parse(uint8_t* data, size_t size, const MessageCallback& callback);
+
+private:
+    // validates the packet if callback is a nullptr. depth counts the enclosing bundles
+    bool parsePacket(uint8_t* data, size_t size, uint64_t timetag, int depth, const MessageCallback* callback);
+
+    bool parseMessage(uint8_t* data, size_t size, uint64_t timetag, const MessageCallback* callback);
+
+    std::vector<OscArgument> mArguments;
+};
+
+// converts an NTP timetag to seconds from now on, immediate timetags return 0
+double oscTimetagToDelay(uint64_t timetag);
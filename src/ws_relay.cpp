@@ -0,0 +1,80 @@
+#include "ws_relay.h"
+#include "ws_trace.h"
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/dispatch.hpp>
+
+UdpRelay::UdpRelay(boost::asio::any_io_executor executor, UdpRelayConfig config, ReplyCallback replyCallback):
+    mSocket(std::move(executor)),
+    mConfig(std::move(config)),
+    mReplyCallback(std::move(replyCallback))
+{}
+
+void UdpRelay::start(boost::system::error_code& ec) {
+    // bind to an ephemeral port, so replies can be told apart from those of other connections
+    mSocket.open(mConfig.target.protocol(), ec);
+    if (ec) {
+        return;
+    }
+    mSocket.bind(boost::asio::ip::udp::endpoint(mConfig.target.protocol(), 0), ec);
+    if (ec) {
+        return;
+    }
+    doReceive();
+}
+
+void UdpRelay::stop() {
+    boost::asio::dispatch(mSocket.get_executor(), [self = shared_from_this()]() {
+        boost::system::error_code ec;
+        self->mSocket.close(ec);
+    });
+}
+
+bool UdpRelay::relay(const WebSocketDataView& message) {
+    auto payload = WebSocketPayload::copyFrom(message.data, message.size, false);
+    auto buffer = payload.buffer();
+    mSocket.async_send_to(
+        buffer,
+        mConfig.target,
+        [payload = std::move(payload), port = mConfig.target.port()](boost::system::error_code ec, std::size_t) {
+            if (ec && ec != boost::asio::error::operation_aborted) {
+                trace(TraceEvent::relaySendFailed, port, ec);
+            }
+        }
+    );
+
+    std::string_view packet(reinterpret_cast<const char*>(message.data), message.size);
+    for (const auto& prefix : mConfig.mirrorPrefixes) {
+        if (packet.substr(0, prefix.size()) == prefix) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void UdpRelay::doReceive() {
+    mSocket.async_receive_from(
+        boost::asio::buffer(mReceiveBuffer),
+        mSenderEndpoint,
+        [self = shared_from_this()](boost::system::error_code ec, std::size_t bytesTransferred) {
+            self->onReceive(ec, bytesTransferred);
+        }
+    );
+}
+
+void UdpRelay::onReceive(boost::system::error_code ec, std::size_t bytesTransferred) {
+    if (ec == boost::asio::error::operation_aborted) {
+        return;
+    }
+    if (ec) {
+        // a target which is not running yet gets reported as refused connection, so keep on receiving
+        if (ec != boost::asio::error::connection_refused) {
+            trace(TraceEvent::relayReceiveFailed, mConfig.target.port(), ec);
+            return;
+        }
+    } else if (mSenderEndpoint == mConfig.target && mReplyCallback) {
+        // only replies of the relay target get passed on
+        mReplyCallback(mReceiveBuffer.data(), bytesTransferred);
+    }
+    doReceive();
+}
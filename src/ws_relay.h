@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/ip/udp.hpp>
+
+#include "ws_common.h"
+
+// target of a relay - an unspecified port disables relaying
+struct UdpRelayConfig {
+    boost::asio::ip::udp::endpoint target;
+    // packets starting with one of these prefixes, e.g. an OSC address like `/n_go`,
+    // still get passed on to sclang
+    std::vector<std::string> mirrorPrefixes;
+
+    bool isEnabled() const { return target.port() != 0; }
+};
+
+/** Forwards binary messages of a connection as UDP datagrams, e.g. to scsynth,
+without passing them through sclang.
+Every relay sends from its own socket, so replies which get sent back to
+the sender address can be routed back to the originating connection.
+The relay has to run on the executor of its connection.
+*/
+class UdpRelay : public std::enable_shared_from_this<UdpRelay> {
+public:
+    using ReplyCallback = std::function<void(const uint8_t* data, size_t size)>;
+
+    UdpRelay(boost::asio::any_io_executor executor, UdpRelayConfig config, ReplyCallback replyCallback);
+
+    // opens the socket and starts receiving replies
+    void start(boost::system::error_code& ec);
+
+    void stop();
+
+    // sends the message and returns true if it should also be passed on to sclang
+    bool relay(const WebSocketDataView& message);
+
+private:
+    void doReceive();
+
+    void onReceive(boost::system::error_code ec, std::size_t bytesTransferred);
+
+    boost::asio::ip::udp::socket mSocket;
+    UdpRelayConfig mConfig;
+    ReplyCallback mReplyCallback;
+    boost::asio::ip::udp::endpoint mSenderEndpoint;
+    // the maximum size of a UDP datagram
+    std::array<uint8_t, 65536> mReceiveBuffer;
+};
@@ -1,5 +1,5 @@
+#include <filesystem>
 #include <queue>
-#include <iostream>
 
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
@@ -7,9 +7,7 @@
 #include <boost/asio/strand.hpp>
 
 #include "ws_server.h"
-
-
-#define SC_WEBSOCKET_DEBUG
+#include "ws_trace.h"
 
 namespace beast = boost::beast;
 using tcp = boost::asio::ip::tcp;
@@ -17,86 +15,260 @@ using tcp = boost::asio::ip::tcp;
 static std::atomic<int32_t> gSessionCounter = 0;
 
 
-WebSocketSession::WebSocketSession(boost::asio::ip::tcp::socket&& socket, int listeningPort, int sessionId):
+WebSocketSession::WebSocketSession(TransportSocket&& socket, int listeningPort, int sessionId,
+                                   std::weak_ptr<WebSocketListener> listener,
+                                   const beast::websocket::permessage_deflate& compression, bool topicControlFrames,
+                                   const KeepAliveOptions& keepAlive):
     mWs(std::move(socket)),
+    // the batcher is a member, so it can not outlive the session
+    mBatcher(mWs.get_executor(), [this](const WebSocketDataView* messages, size_t numMessages) {
+        if (mMessageReceivedCallback) {
+            mMessageReceivedCallback(messages, numMessages);
+        }
+    }),
+    mOutQueue(
+        mWs.get_executor(),
+        [this](bool isAboveHighWatermark) {
+            if (mQueueStateCallback) {
+                mQueueStateCallback(isAboveHighWatermark);
+            }
+        },
+        // a slow consumer gets disconnected
+        [this]() {
+            mStats.setDisconnectReason(DisconnectReason::slowConsumer);
+            close();
+        }
+    ),
+    mScheduledSends(mWs.get_executor(), [this](WebSocketPayload message) {
+        mOutQueue.push(std::move(message), shared_from_this());
+        doWrite();
+    }),
     mListeningPort(listeningPort),
-    mSessionId(sessionId)
-{}
+    mSessionId(sessionId),
+    mListener(std::move(listener)),
+    mTopicControlFrames(topicControlFrames),
+    mKeepAlive(keepAlive),
+    mPingTimer(mWs.get_executor())
+{
+    mWs.set_option(compression);
+    beast::get_lowest_layer(mWs).setNoDelay();
+}
 
 void WebSocketSession::run() {
-#ifdef SC_WEBSOCKET_DEBUG
-    std::cout << "Start run of session" << std::endl;
-#endif
     boost::asio::dispatch(mWs.get_executor(), beast::bind_front_handler(&WebSocketSession::onRun, shared_from_this()));
 }
 
-void WebSocketSession::enqueueMessage(WebSocketData message) {
-    // dispatch via asio to ensure thread safety
-    boost::asio::dispatch(mWs.get_executor(), [message, self = shared_from_this()]() mutable {
-        self->mOutQueue.push(message);
-        self->doWrite();
+bool WebSocketSession::enqueueMessage(WebSocketPayload message) {
+    // the common case neither allocates nor wakes up the strand more than once per burst
+    auto isPushed = mSubmissions.push(message);
+    if (!isPushed && !mSubmissions.isBypassing()) {
+        // the ring is full, so the strand is behind - apply the overflow policy right here
+        if (mOutQueue.dropsOnOverflow()) {
+            mOutQueue.recordDropped();
+            return false;
+        }
+        // an io thread must not wait, as it may have to run the strand which makes room
+        if (!runsOnIoThread(mWs.get_executor())) {
+            isPushed = mSubmissions.pushWaiting(message);
+        }
+    }
+    if (isPushed) {
+        if (mSubmissions.needsWakeup()) {
+            boost::asio::post(
+                mWs.get_executor(),
+                bindHandlerMemory(mSubmitMemory, [self = shared_from_this()]() { self->drainSubmissions(); })
+            );
+        }
+        return true;
+    }
+    dispatchOrdered([message = std::move(message)](WebSocketSession& self) mutable {
+        self.mOutQueue.push(std::move(message), self.shared_from_this());
+    });
+    return true;
+}
+
+void WebSocketSession::enqueueKeyedMessage(std::string key, WebSocketPayload message) {
+    dispatchOrdered([key = std::move(key), message = std::move(message)](WebSocketSession& self) mutable {
+        self.mOutQueue.push(std::move(message), self.shared_from_this(), std::move(key));
     });
 }
 
-void WebSocketSession::close() {
-    mWs.close("Goodbye");
-    if (mConnectionStateCallback) {
-        mConnectionStateCallback(false);
-    };
+void WebSocketSession::enqueueMessages(std::vector<WebSocketPayload> messages) {
+    // a single dispatch for the whole batch
+    dispatchOrdered([messages = std::move(messages)](WebSocketSession& self) mutable {
+        auto keepAlive = self.shared_from_this();
+        for (auto& message : messages) {
+            self.mOutQueue.push(std::move(message), keepAlive);
+        }
+    });
+}
+
+void WebSocketSession::enqueueMessageAt(std::chrono::steady_clock::time_point time, WebSocketPayload message) {
+    dispatchOrdered([time, message = std::move(message)](WebSocketSession& self) mutable {
+        if (!self.mRetired) {
+            self.mScheduledSends.schedule(time, std::move(message), self.shared_from_this());
+        }
+    });
+}
+
+template <class Function>
+void WebSocketSession::dispatchOrdered(Function&& function) {
+    mSubmissions.beginBypass();
+    boost::asio::dispatch(
+        mWs.get_executor(),
+        [function = std::forward<Function>(function), self = shared_from_this()]() mutable {
+            // messages which have been submitted before go first
+            self->drainSubmissions();
+            function(*self);
+            self->mSubmissions.endBypass();
+            self->doWrite();
+        }
+    );
+}
+
+void WebSocketSession::drainSubmissions() {
+    auto self = shared_from_this();
+    mSubmissions.drain([&self, this](WebSocketPayload message) { mOutQueue.push(std::move(message), self); });
+    doWrite();
 }
 
-boost::asio::const_buffer WebSocketSession::toAsioBuffer(const WebSocketData& message) {
-    return std::visit([](const auto& arg) { return boost::asio::buffer(arg); }, message);
+void WebSocketSession::close() {
+    // close gets called from sclang, so move onto the strand of the session
+    boost::asio::dispatch(mWs.get_executor(), [self = shared_from_this()]() {
+        self->mStats.setDisconnectReason(DisconnectReason::local);
+        self->retire();
+        self->mWs.async_close(beast::websocket::close_reason("Goodbye"),
+                              beast::bind_front_handler(&WebSocketSession::onClose, self));
+    });
 }
 
 void WebSocketSession::onRun() {
-#ifdef SC_WEBSOCKET_DEBUG
-    std::cout << "Session started" << std::endl;
-#endif
-    mWs.set_option(beast::websocket::stream_base::timeout::suggested((beast::role_type::server)));
+    trace(TraceEvent::sessionStarted, mSessionId);
+    mWs.set_option(keepAliveTimeout(mKeepAlive, beast::role_type::server));
+    mWs.control_callback([this](beast::websocket::frame_type kind, beast::string_view payload) {
+        if (kind == beast::websocket::frame_type::pong) {
+            recordPong(mStats.rtt, payload);
+        }
+    });
 
     mWs.async_accept(beast::bind_front_handler(&WebSocketSession::onAccept, shared_from_this()));
 }
 
 void WebSocketSession::onAccept(beast::error_code ec) {
     if (ec) {
-#ifdef SC_WEBSOCKET_DEBUG
-        std::cout << "Session accept error: " << ec.message().c_str() << std::endl;
-#endif
+        trace(TraceEvent::sessionHandshakeFailed, mSessionId, ec);
+        mStats.setDisconnectReason(disconnectReasonFromError(ec));
+        if (auto listener = mListener.lock()) {
+            listener->recordHandshakeFailure();
+        }
+        retire();
         return;
     }
-#ifdef SC_WEBSOCKET_DEBUG
-    std::cout << "Session accepted" << std::endl;
-#endif
+    trace(TraceEvent::sessionAccepted, mSessionId);
+    if (auto listener = mListener.lock()) {
+        listener->addSession(shared_from_this());
+    }
 
     if (mConnectionStateCallback) {
         mConnectionStateCallback(true);
     }
+    mPingTimer.start(mKeepAlive.pingInterval, [this]() { sendPing(); }, shared_from_this());
     doRead();
 }
 
+void WebSocketSession::sendPing() {
+    if (mPingPending) {
+        return;
+    }
+    mPingPending = true;
+    mWs.async_ping(makePingPayload(), [self = shared_from_this()](beast::error_code) { self->mPingPending = false; });
+}
+
+void WebSocketSession::setMessageBatching(size_t maxMessages, size_t maxBytes, std::chrono::microseconds maxLatency) {
+    boost::asio::dispatch(mWs.get_executor(), [=, self = shared_from_this()]() {
+        self->mBatcher.configure(maxMessages, maxBytes, maxLatency);
+    });
+}
+
+void WebSocketSession::setQueueLimits(const QueueLimits& limits) {
+    boost::asio::dispatch(mWs.get_executor(), [=, self = shared_from_this()]() {
+        self->mOutQueue.configure(limits);
+    });
+}
+
+void WebSocketSession::setJsonPointers(std::vector<std::string> pointers) {
+    boost::asio::dispatch(mWs.get_executor(), [pointers = std::move(pointers), self = shared_from_this()]() mutable {
+        self->mJsonDecoder.setPointers(std::move(pointers));
+    });
+}
+
+CompressionStats WebSocketSession::getCompressionStats() const {
+    auto& wireCounters = mWs.next_layer().counters();
+    return CompressionStats{
+        .messageBytesRead = mStats.bytesRead.load(std::memory_order_relaxed),
+        .messageBytesWritten = mStats.bytesWritten.load(std::memory_order_relaxed),
+        .wireBytesRead = wireCounters.bytesRead.load(std::memory_order_relaxed),
+        .wireBytesWritten = wireCounters.bytesWritten.load(std::memory_order_relaxed),
+    };
+}
+
+std::string WebSocketSession::getStatsJson() const {
+    auto& wireCounters = mWs.next_layer().counters();
+    return connectionStatsToJson(
+        mStats,
+        mOutQueue.getStats(),
+        WireStats{
+            .bytesRead = wireCounters.bytesRead.load(std::memory_order_relaxed),
+            .bytesWritten = wireCounters.bytesWritten.load(std::memory_order_relaxed),
+        }
+    );
+}
+
+void WebSocketSession::onClose(beast::error_code ec) {
+    if (ec) {
+        trace(TraceEvent::sessionCloseFailed, mSessionId, ec);
+    }
+}
+
 void WebSocketSession::doRead() {
-    mWs.async_read(mBuffer, beast::bind_front_handler(&WebSocketSession::onRead, shared_from_this()));
+    mWs.async_read(
+        mBuffer,
+        bindHandlerMemory(mReadMemory, beast::bind_front_handler(&WebSocketSession::onRead, shared_from_this()))
+    );
 }
 
 void WebSocketSession::onRead(beast::error_code ec, std::size_t bytesTransferred) {
     if (ec) {
+        mStats.setDisconnectReason(disconnectReasonFromError(ec));
         if (ec == boost::asio::error::eof || ec == beast::websocket::error::closed
             || ec == boost::asio::error::operation_aborted) {
-#ifdef SC_WEBSOCKET_DEBUG
-            std::cout << "Session closed" << std::endl;
-#endif
-            mConnectionStateCallback(false);
+            trace(TraceEvent::sessionClosed, mSessionId);
         } else {
-            std::cout << "Websocket connection error: " << ec.message().c_str() << std::endl;
+            trace(TraceEvent::sessionReadFailed, mSessionId, ec);
         };
+        retire();
         // SC_Websocket_Lang::WebSocketConnection::closeLangConnection(m_ownAddress);
         return;
     }
-    auto message = convertData(mBuffer, bytesTransferred, mWs.got_text());
-    if (mMessageReceivedCallback) {
-        mMessageReceivedCallback(message);
+    mStats.recordRead(bytesTransferred);
+    trace(TraceEvent::sessionRead, mSessionId, bytesTransferred);
+    auto message = viewData(mBuffer, bytesTransferred, mWs.got_text());
+    if (mTopicControlFrames && handleTopicControlFrame(message)) {
+        // got handled by the listener
+    } else if (mUdpRelay && !message.isText && !mUdpRelay->relay(message)) {
+        // got relayed without being mirrored to sclang
+    } else if (!message.isText && mOscMessageCallback && mOscParser.parse(message.data, message.size, mOscMessageCallback)) {
+        // got delivered as decoded OSC
+    } else if (message.isText && mJsonCallback
+               && mJsonDecoder.parse(reinterpret_cast<const char*>(message.data), message.size, mJsonCallback)) {
+        // got delivered as decoded JSON
+    } else if (mBatcher.isEnabled()) {
+        mBatcher.push(message, shared_from_this());
+    } else if (mMessageReceivedCallback) {
+        mMessageReceivedCallback(&message, 1);
     }
+    // the view is invalid from here on
+    mBuffer.consume(bytesTransferred);
     // continue async loop to await websocket message
     doRead();
 }
@@ -104,26 +276,132 @@ void WebSocketSession::onRead(beast::error_code ec, std::size_t bytesTransferred
 void WebSocketSession::doWrite() {
     if (!mIsWriting && !mOutQueue.empty()) {
         mIsWriting = true;
-        auto message = mOutQueue.front();
+        mWritingMessage = mOutQueue.pop();
 
         // if a string, indicate it as a text message
-        mWs.text(std::holds_alternative<std::string>(message));
+        mWs.text(mWritingMessage.isText());
 
-        mWs.async_write(boost::asio::buffer(toAsioBuffer(message)),
-                        boost::beast::bind_front_handler(&WebSocketSession::onWrite, shared_from_this()));
+        mWriteStartedAt = std::chrono::steady_clock::now();
+        mWs.async_write(
+            mWritingMessage.buffer(),
+            bindHandlerMemory(mWriteMemory, beast::bind_front_handler(&WebSocketSession::onWrite, shared_from_this()))
+        );
     }
 }
 
 void WebSocketSession::onWrite(beast::error_code ec, std::size_t bytesTransferred) {
     mIsWriting = false;
     if (ec) {
-        std::cout << "Sending websocket message failed: " << ec.message().c_str() << std::endl;
+        trace(TraceEvent::sessionWriteFailed, mSessionId, ec);
+    } else {
+        mStats.recordWrite(bytesTransferred, std::chrono::steady_clock::now() - mWriteStartedAt);
+        trace(TraceEvent::sessionWrite, mSessionId, bytesTransferred);
     }
-    mOutQueue.pop();
+    mWritingMessage = WebSocketPayload();
     // do this loop until our queue is empty
     doWrite();
 }
 
+void WebSocketSession::runOnStrand(std::function<void()> function) {
+    boost::asio::dispatch(mWs.get_executor(), [function = std::move(function), self = shared_from_this()]() {
+        function();
+    });
+}
+
+void WebSocketSession::setUdpRelay(const UdpRelayConfig& config) {
+    boost::asio::dispatch(mWs.get_executor(), [config, self = shared_from_this()]() {
+        self->stopUdpRelay();
+        if (!config.isEnabled()) {
+            return;
+        }
+        // the relay must not keep the session alive
+        std::weak_ptr<WebSocketSession> weakSelf = self;
+        auto relay = std::make_shared<UdpRelay>(
+            self->mWs.get_executor(),
+            config,
+            [weakSelf](const uint8_t* data, size_t size) {
+                if (auto session = weakSelf.lock()) {
+                    session->enqueueMessage(WebSocketPayload::copyFrom(data, size, false));
+                }
+            }
+        );
+        boost::system::error_code ec;
+        relay->start(ec);
+        if (ec) {
+            trace(TraceEvent::relayStartFailed, self->mSessionId, ec);
+            return;
+        }
+        self->mUdpRelay = std::move(relay);
+    });
+}
+
+void WebSocketSession::stopUdpRelay() {
+    if (mUdpRelay) {
+        mUdpRelay->stop();
+        mUdpRelay = nullptr;
+    }
+}
+
+void WebSocketSession::setSubscribed(const std::string& topic, bool subscribed) {
+    if (auto listener = mListener.lock()) {
+        if (subscribed) {
+            listener->subscribe(mSessionId, topic);
+        } else {
+            listener->unsubscribe(mSessionId, topic);
+        }
+    }
+}
+
+bool WebSocketSession::handleTopicControlFrame(const WebSocketDataView& message) {
+    std::string_view frame(reinterpret_cast<const char*>(message.data), message.size);
+    if (frame.substr(0, 5) == "#pub ") {
+        auto topicEnd = frame.find('\n');
+        if (topicEnd == std::string_view::npos) {
+            return false;
+        }
+        if (auto listener = mListener.lock()) {
+            // forwarded to the other subscribers, but not back to the publisher
+            listener->publish(
+                std::string(frame.substr(5, topicEnd - 5)),
+                WebSocketPayload::copyFrom(message.data + topicEnd + 1, message.size - topicEnd - 1, message.isText),
+                mSessionId
+            );
+        }
+        return true;
+    }
+    if (!message.isText) {
+        return false;
+    }
+    if (frame.substr(0, 5) == "#sub ") {
+        setSubscribed(std::string(frame.substr(5)), true);
+        return true;
+    }
+    if (frame.substr(0, 7) == "#unsub ") {
+        setSubscribed(std::string(frame.substr(7)), false);
+        return true;
+    }
+    return false;
+}
+
+void WebSocketSession::retire() {
+    if (mRetired) {
+        return;
+    }
+    mRetired = true;
+    mPingTimer.stop();
+    mScheduledSends.cancel();
+    stopUdpRelay();
+    // deliver what has been received and report the disconnect exactly once, before the
+    // listener hands the session over to be reaped
+    mBatcher.flush();
+    if (mConnectionStateCallback) {
+        mConnectionStateCallback(false);
+    }
+    if (auto listener = mListener.lock()) {
+        listener->removeSession(*this);
+    }
+}
+
 WebSocketListener::WebSocketListener(
     boost::asio::io_context& ioContext,
     std::string& host,
@@ -131,84 +409,317 @@ WebSocketListener::WebSocketListener(
     beast::error_code& ec
 ):
     mIoContext(ioContext),
-    mAcceptor(ioContext),
-    mEndpoint(boost::asio::ip::address::from_string(host), port)
+    mAcceptor(boost::asio::make_strand(ioContext)),
+    mLocalPath(localSocketPath(host)),
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    mLocalAcceptor(mAcceptor.get_executor()),
+#endif
+    mPort(port),
+    mStatsTimer(mAcceptor.get_executor())
 {
+    if (!mLocalPath.empty()) {
+        openLocal(ec);
+        return;
+    }
+    mEndpoint = tcp::endpoint(boost::asio::ip::address::from_string(host), port);
+
     mAcceptor.open(mEndpoint.protocol(), ec);
     if (ec) {
-#ifdef SC_WEBSOCKET_DEBUG
-        std::cout << "Could not open endpoint - " << ec.message().c_str() << std::endl;
-#endif
+        trace(TraceEvent::listenerOpenFailed, port, ec);
         return;
     }
 
     mAcceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true), ec);
     if (ec) {
-#ifdef SC_WEBSOCKET_DEBUG
-        std::cout << "Could not set reuse address: " << ec.message().c_str() << std::endl;
-#endif
+        trace(TraceEvent::listenerOpenFailed, port, ec);
         return;
     }
 
     mAcceptor.bind(mEndpoint, ec);
     if (ec) {
-#ifdef SC_WEBSOCKET_DEBUG
-        std::cout << "Could not bind to endpoint: " << ec.message().c_str() << std::endl;
-#endif
+        trace(TraceEvent::listenerOpenFailed, port, ec);
         return;
     }
 
     mAcceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
     if (ec) {
-#ifdef SC_WEBSOCKET_DEBUG
-        std::cout << "Could not listen on endpoint: " << ec.message().c_str() << std::endl;
-#endif
+        trace(TraceEvent::listenerOpenFailed, port, ec);
         return;
     }
 }
 
-void WebSocketListener::run() {
-#ifdef SC_WEBSOCKET_DEBUG
-    std::cout << "Starting websocket listener..." << std::endl;
+void WebSocketListener::openLocal(beast::error_code& ec) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (isLocalSocketPathTooLong(mLocalPath)) {
+        ec = boost::asio::error::name_too_long;
+        trace(TraceEvent::listenerOpenFailed, mPort, ec);
+        return;
+    }
+    boost::asio::local::stream_protocol::endpoint endpoint(mLocalPath);
+    // the socket file of a previous run which did not stop its listener would fail the bind.
+    // only sockets nobody listens on get removed, so neither a running listener nor a regular
+    // file at a mistyped path gets deleted
+    std::error_code fileEc;
+    if (std::filesystem::is_socket(mLocalPath, fileEc)) {
+        boost::asio::local::stream_protocol::socket probe(mIoContext);
+        beast::error_code probeEc;
+        probe.connect(endpoint, probeEc);
+        if (!probeEc) {
+            ec = boost::asio::error::address_in_use;
+            trace(TraceEvent::listenerOpenFailed, mPort, ec);
+            return;
+        }
+        std::filesystem::remove(mLocalPath, fileEc);
+    }
+
+    mLocalAcceptor.open(endpoint.protocol(), ec);
+    if (ec) {
+        trace(TraceEvent::listenerOpenFailed, mPort, ec);
+        return;
+    }
+
+    mLocalAcceptor.bind(endpoint, ec);
+    if (ec) {
+        trace(TraceEvent::listenerOpenFailed, mPort, ec);
+        return;
+    }
+
+    mLocalAcceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
+    if (ec) {
+        trace(TraceEvent::listenerOpenFailed, mPort, ec);
+        return;
+    }
+#else
+    ec = boost::asio::error::operation_not_supported;
+    trace(TraceEvent::listenerOpenFailed, mPort, ec);
 #endif
-    doAccept();
+}
+
+void WebSocketListener::run() {
+    trace(TraceEvent::listenerStarted, mPort);
+    boost::asio::dispatch(mAcceptor.get_executor(),
+                          beast::bind_front_handler(&WebSocketListener::doAccept, shared_from_this()));
 }
 
 void WebSocketListener::stop() {
-    boost::system::error_code ec;
-    mAcceptor.close(ec);
-    if (ec) {
-        std::cout << "Could not close websocket: " << ec.message().c_str() << std::endl;
+    // the acceptor may be in use by the io threads, so close it on its strand
+    boost::asio::dispatch(mAcceptor.get_executor(), [self = shared_from_this()]() {
+        self->mStatsTimer.stop();
+        boost::system::error_code ec;
+        self->mAcceptor.close(ec);
+        if (ec) {
+            trace(TraceEvent::listenerCloseFailed, self->mPort, ec);
+        }
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        if (self->mLocalAcceptor.is_open()) {
+            self->mLocalAcceptor.close(ec);
+            if (ec) {
+                trace(TraceEvent::listenerCloseFailed, self->mPort, ec);
+            }
+            std::error_code fileEc;
+            std::filesystem::remove(self->mLocalPath, fileEc);
+        }
+#endif
+    });
+}
+
+void WebSocketListener::setCompression(const beast::websocket::permessage_deflate& compression) {
+    boost::asio::dispatch(mAcceptor.get_executor(), [compression, self = shared_from_this()]() {
+        self->mCompression = compression;
+    });
+}
+
+void WebSocketListener::setKeepAlive(const KeepAliveOptions& keepAlive) {
+    boost::asio::dispatch(mAcceptor.get_executor(), [keepAlive, self = shared_from_this()]() {
+        self->mKeepAlive = keepAlive;
+    });
+}
+
+void WebSocketListener::setTopicControlFrames(bool enabled) {
+    boost::asio::dispatch(mAcceptor.get_executor(), [enabled, self = shared_from_this()]() {
+        self->mTopicControlFrames = enabled;
+    });
+}
+
+std::string WebSocketListener::getStatsJson() {
+    std::vector<std::shared_ptr<WebSocketSession>> sessions;
+    {
+        std::lock_guard<std::mutex> lock(mSessionsMutex);
+        sessions.reserve(mSessions.size());
+        for (auto& [sessionId, weakSession] : mSessions) {
+            if (auto session = weakSession.lock()) {
+                sessions.push_back(std::move(session));
+            }
+        }
+    }
+    // the sessions are keyed by their handle, as this is how sclang identifies them
+    std::string sessionsJson = "{";
+    for (auto& session : sessions) {
+        if (sessionsJson.size() > 1) {
+            sessionsJson += ',';
+        }
+        sessionsJson += '"' + std::to_string(session->getHandle()) + "\":" + session->getStatsJson();
+    }
+    sessionsJson += '}';
+    return listenerStatsToJson(mStats, sessions.size(), sessionsJson);
+}
+
+void WebSocketListener::setStatsInterval(std::chrono::milliseconds interval, StatsCallback callback) {
+    boost::asio::dispatch(mAcceptor.get_executor(), [=, self = shared_from_this()]() {
+        self->mStatsTimer.start(interval, [self = self.get(), callback]() { callback(self->getStatsJson()); }, self);
+    });
+}
+
+void WebSocketListener::setNewSessionCallback(NewSessionCallback callback) {
+    std::lock_guard<std::mutex> lock(mCallbackMutex);
+    mNewSessionCallback = std::move(callback);
+}
+
+void WebSocketListener::setSessionRetiredCallback(SessionRetiredCallback callback) {
+    std::lock_guard<std::mutex> lock(mCallbackMutex);
+    mSessionRetiredCallback = std::move(callback);
+}
+
+void WebSocketListener::setUdpRelay(const UdpRelayConfig& config) {
+    boost::asio::dispatch(mAcceptor.get_executor(), [config, self = shared_from_this()]() {
+        self->mUdpRelayConfig = config;
+    });
+}
+
+void WebSocketListener::subscribe(int sessionId, const std::string& topic) {
+    std::lock_guard<std::mutex> lock(mSessionsMutex);
+    mTopics[topic].insert(sessionId);
+}
+
+void WebSocketListener::unsubscribe(int sessionId, const std::string& topic) {
+    std::lock_guard<std::mutex> lock(mSessionsMutex);
+    if (auto it = mTopics.find(topic); it != mTopics.end()) {
+        it->second.erase(sessionId);
+        if (it->second.empty()) {
+            mTopics.erase(it);
+        }
+    }
+}
+
+size_t WebSocketListener::publish(const std::string& topic, const WebSocketPayload& message, int excludedSessionId) {
+    std::lock_guard<std::mutex> lock(mSessionsMutex);
+    auto topicIt = mTopics.find(topic);
+    if (topicIt == mTopics.end()) {
+        return 0;
+    }
+    size_t numSessions = 0;
+    for (auto sessionId : topicIt->second) {
+        if (sessionId == excludedSessionId) {
+            continue;
+        }
+        if (auto it = mSessions.find(sessionId); it != mSessions.end()) {
+            if (auto session = it->second.lock()) {
+                session->enqueueMessage(message.share());
+                numSessions++;
+            }
+        }
+    }
+    return numSessions;
+}
+
+size_t WebSocketListener::broadcast(const WebSocketPayload& message) {
+    std::lock_guard<std::mutex> lock(mSessionsMutex);
+    size_t numSessions = 0;
+    for (auto it = mSessions.begin(); it != mSessions.end();) {
+        if (auto session = it->second.lock()) {
+            session->enqueueMessage(message.share());
+            numSessions++;
+            ++it;
+        } else {
+            it = mSessions.erase(it);
+        }
+    }
+    return numSessions;
+}
+
+void WebSocketListener::addSession(const std::shared_ptr<WebSocketSession>& session) {
+    std::lock_guard<std::mutex> lock(mSessionsMutex);
+    mSessions.insert_or_assign(session->getSessionId(), session);
+}
+
+void WebSocketListener::removeSession(WebSocketSession& session) {
+    mStats.disconnects[static_cast<size_t>(session.getDisconnectReason())].fetch_add(1, std::memory_order_relaxed);
+    auto sessionId = session.getSessionId();
+    {
+        std::lock_guard<std::mutex> lock(mSessionsMutex);
+        mSessions.erase(sessionId);
+        for (auto it = mTopics.begin(); it != mTopics.end();) {
+            it->second.erase(sessionId);
+            if (it->second.empty()) {
+                it = mTopics.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    SessionRetiredCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mCallbackMutex);
+        callback = mSessionRetiredCallback;
+    }
+    if (callback) {
+        callback(session);
     }
 }
 
 void WebSocketListener::doAccept() {
-#ifdef SC_WEBSOCKET_DEBUG
-    std::cout << "Starting websocket accept..." << std::endl;
+    // every session gets its own strand, so sessions can be served by multiple io threads
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (!mLocalPath.empty()) {
+        mLocalAcceptor.async_accept(
+            boost::asio::make_strand(mIoContext),
+            [self = shared_from_this()](beast::error_code ec, boost::asio::local::stream_protocol::socket socket) {
+                self->onAccept(ec, TransportSocket(std::move(socket)));
+            }
+        );
+        return;
+    }
 #endif
-    mAcceptor.async_accept(boost::asio::make_strand(mIoContext),
-                           beast::bind_front_handler(&WebSocketListener::onAccept, shared_from_this()));
+    mAcceptor.async_accept(
+        boost::asio::make_strand(mIoContext),
+        [self = shared_from_this()](beast::error_code ec, tcp::socket socket) {
+            self->onAccept(ec, TransportSocket(std::move(socket)));
+        }
+    );
 }
 
-void WebSocketListener::onAccept(beast::error_code ec, boost::asio::ip::tcp::socket socket) {
+void WebSocketListener::onAccept(beast::error_code ec, TransportSocket socket) {
     if (ec) {
         if (ec == boost::asio::error::operation_aborted) {
             return;
         }
-        std::cout << "Could not accept connection: " << ec.message().c_str() << std::endl;
+        mStats.acceptFailures.fetch_add(1, std::memory_order_relaxed);
+        trace(TraceEvent::acceptFailed, mPort, ec);
         return;
     }
-#ifdef SC_WEBSOCKET_DEBUG
-    std::cout << "accepted connection" << std::endl;
-#endif
+    mStats.accepted.fetch_add(1, std::memory_order_relaxed);
+    trace(TraceEvent::accepted, mPort);
+    auto listeningPort = socket.isLocal() ? mPort : mAcceptor.local_endpoint().port();
     auto session = std::make_shared<WebSocketSession>(
         std::move(socket),
-        mAcceptor.local_endpoint().port(),
-        gSessionCounter++
+        listeningPort,
+        gSessionCounter++,
+        weak_from_this(),
+        mCompression,
+        mTopicControlFrames,
+        mKeepAlive
     );
 
-    if (mNewSessionCallback) {
-        mNewSessionCallback(session);
+    NewSessionCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mCallbackMutex);
+        callback = mNewSessionCallback;
+    }
+    if (callback) {
+        callback(session);
+    }
+    if (mUdpRelayConfig.isEnabled()) {
+        session->setUdpRelay(mUdpRelayConfig);
     }
     // session->m_ownAddress = session.get();
     session->run();
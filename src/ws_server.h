@@ -1,21 +1,34 @@
 #pragma once
 
+#include <mutex>
 #include <queue>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/asio/ip/tcp.hpp>
 
 #include "ws_common.h"
+#include "ws_json.h"
+#include "ws_memory.h"
+#include "ws_mpsc.h"
+#include "ws_osc.h"
+#include "ws_relay.h"
+#include "ws_stream.h"
 
 namespace beast = boost::beast;
 using tcp = boost::asio::ip::tcp;
 
 class WebSocketSession;
+class WebSocketListener;
 using NewSessionCallback = std::function<void(std::shared_ptr<WebSocketSession>)>;
 using SessionConnectionStateCallback = std::function<void(bool)>;
-using SessionMessageReceivedCallback = std::function<void(WebSocketData& message)>;
+using SessionQueueStateCallback = std::function<void(bool isAboveHighWatermark)>;
+using SessionRetiredCallback = std::function<void(WebSocketSession& session)>;
+// gets called with a single message, or with multiple messages if batching is enabled
+using SessionMessageReceivedCallback = std::function<void(const WebSocketDataView* messages, size_t numMessages)>;
 
 // websocket server implementation using boost beast
 // communication with primitives is handeled in `SC_WebSocketPrim`.
@@ -24,14 +37,42 @@ using SessionMessageReceivedCallback = std::function<void(WebSocketData& message
 // A WebSocketSession is essentially a websocket connection from our WebSocket server.
 // This gets build by the WebSocketListener.
 class WebSocketSession : public std::enable_shared_from_this<WebSocketSession> {
-    beast::websocket::stream<tcp::socket> mWs;
+    beast::websocket::stream<CountingStream<TransportSocket>> mWs;
     beast::flat_buffer mBuffer;
-    std::queue<WebSocketData> mOutQueue;
+    MessageBatcher mBatcher;
+    OscParser mOscParser;
+    JsonDecoder mJsonDecoder;
+    OutboundQueue mOutQueue;
+    // messages which wait for the time they should be sent at
+    SendScheduler mScheduledSends;
+    // messages which have been sent from other threads and wait for the strand
+    SubmissionQueue<WebSocketPayload> mSubmissions;
+    // recycled by the operations of the read, write and submission loops
+    HandlerMemory mReadMemory;
+    HandlerMemory mWriteMemory;
+    HandlerMemory mSubmitMemory;
+    // the message which is currently written, kept alive until the write has completed
+    WebSocketPayload mWritingMessage;
     // a primitive mutex - see `do_write` and `on_write` - @todo use atomic in this case?
     bool mIsWriting = false;
     int mListeningPort;
-    // identifier for sclang side
+    // identifier within the listener
     int mSessionId;
+    // identifier for sclang side, see `HandleTable`
+    int32_t mHandle = -1;
+    // the listener which accepted this session, used to (un)register for broadcasts
+    std::weak_ptr<WebSocketListener> mListener;
+    // if enabled, `#sub`, `#unsub` and `#pub` frames get handled by the listener, see `handleTopicControlFrame`
+    bool mTopicControlFrames;
+    KeepAliveOptions mKeepAlive;
+    // forwards binary messages to a UDP endpoint if set
+    std::shared_ptr<UdpRelay> mUdpRelay;
+    bool mRetired = false;
+    ConnectionStats mStats;
+    std::chrono::steady_clock::time_point mWriteStartedAt;
+    PeriodicTimer mPingTimer;
+    // only a single ping gets written at a time
+    bool mPingPending = false;
 
 public:
     // we store a reference pointer to ourselves upon creation
@@ -41,34 +82,104 @@ public:
     // WebSocketSession* m_ownAddress;
 
     // take ownership of socket
-    explicit WebSocketSession(boost::asio::ip::tcp::socket&& socket, int listeningPort, int sessionId);
+    explicit WebSocketSession(TransportSocket&& socket, int listeningPort, int sessionId,
+                              std::weak_ptr<WebSocketListener> listener,
+                              const beast::websocket::permessage_deflate& compression, bool topicControlFrames,
+                              const KeepAliveOptions& keepAlive);
 
     void run();
 
-    void enqueueMessage(WebSocketData message);
+    // can be called from any thread - returns false if the message got dropped because the
+    // strand is behind and the send queue drops on overflow. Other threads than the io threads
+    // wait for the strand in that case instead of allocating a handler per message.
+    bool enqueueMessage(WebSocketPayload message);
+
+    // replaces a message with the same key which has not been sent yet
+    void enqueueKeyedMessage(std::string key, WebSocketPayload message);
+
+    // enqueues all messages at once, so they get written back to back
+    void enqueueMessages(std::vector<WebSocketPayload> messages);
+
+    // enqueues the message once the time has come, see `SendScheduler`
+    void enqueueMessageAt(std::chrono::steady_clock::time_point time, WebSocketPayload message);
 
     void close();
 
-    // converts WebSocketData to beast flat_buffer
-    static boost::asio::const_buffer toAsioBuffer(const WebSocketData& message);
+    // see `MessageBatcher::configure`
+    void setMessageBatching(size_t maxMessages, size_t maxBytes, std::chrono::microseconds maxLatency);
+
+    void setQueueLimits(const QueueLimits& limits);
+
+    // see `JsonDecoder::setPointers`
+    void setJsonPointers(std::vector<std::string> pointers);
+
+    // can be called from any thread - returns false if the send queue would reject the message
+    bool acceptsMessage(size_t numBytes) const { return mOutQueue.accepts(numBytes); }
+
+    // can be called from any thread
+    CompressionStats getCompressionStats() const;
+
+    // can be called from any thread - a snapshot of the counters as a JSON object
+    std::string getStatsJson() const;
+
+    DisconnectReason getDisconnectReason() const { return mStats.getDisconnectReason(); }
 
     int getSessionId() const { return mSessionId; }
 
+    // needs to be set before running the session
+    void setHandle(int32_t handle) { mHandle = handle; }
+
+    int32_t getHandle() const { return mHandle; }
+
+    // runs the function on the strand of the session, so e.g. a callback
+    // does not get replaced while the session invokes it
+    void runOnStrand(std::function<void()> function);
+
+    // replaces the current relay, a config without target disables relaying
+    void setUdpRelay(const UdpRelayConfig& config);
+
+    // (un)subscribes from a topic of the listener which accepted this session
+    void setSubscribed(const std::string& topic, bool subscribed);
+
     SessionConnectionStateCallback mConnectionStateCallback;
     SessionMessageReceivedCallback mMessageReceivedCallback;
+    SessionQueueStateCallback mQueueStateCallback;
+    // if set, binary messages which are valid OSC get decoded and passed here instead
+    OscParser::MessageCallback mOscMessageCallback;
+    // if set, text messages which are valid JSON get decoded and passed here instead
+    JsonDecoder::FieldCallback mJsonCallback;
 
 private:
     void onRun();
 
+    void sendPing();
+
     void onAccept(beast::error_code ec);
 
+    void onClose(beast::error_code ec);
+
     void doRead();
 
     void onRead(beast::error_code ec, std::size_t bytesTransferred);
 
+    // runs the function on the strand after the pending submissions, so the order of sends is kept
+    template <class Function>
+    void dispatchOrdered(Function&& function);
+
+    void drainSubmissions();
+
     void doWrite(void);
 
     void onWrite(beast::error_code ec, std::size_t bytesTransferred);
+
+    // unregisters from the listener once the session has been closed or failed to connect,
+    // which reports the disconnect - only the first call has an effect
+    void retire();
+
+    void stopUdpRelay();
+
+    // returns true if the message was a topic control frame and got consumed
+    bool handleTopicControlFrame(const WebSocketDataView& message);
 };
 
 // acts as a server which listens for incoming connections
@@ -76,9 +187,37 @@ class WebSocketListener : public std::enable_shared_from_this<WebSocketListener>
     boost::asio::io_context& mIoContext;
     boost::asio::ip::tcp::acceptor mAcceptor;
     boost::asio::ip::tcp::endpoint mEndpoint;
+    // the path of the unix domain socket if the host is of the form `unix:/path`, see `localSocketPath`
+    std::string mLocalPath;
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    boost::asio::local::stream_protocol::acceptor mLocalAcceptor;
+#endif
+    // identifies the listener in traces, unix domain sockets do not have a port of their own
+    int mPort;
+    // gets applied to all sessions accepted afterwards
+    beast::websocket::permessage_deflate mCompression;
+    // gets applied to all sessions accepted afterwards
+    bool mTopicControlFrames = false;
+    // gets applied to all sessions accepted afterwards
+    UdpRelayConfig mUdpRelayConfig;
+    // gets applied to all sessions accepted afterwards
+    KeepAliveOptions mKeepAlive;
+    // all sessions which have completed their handshake and are still open.
+    // accessed from the io thread and the sclang thread, so guard them
+    std::mutex mSessionsMutex;
+    std::unordered_map<int, std::weak_ptr<WebSocketSession>> mSessions;
+    // the ids of the sessions which subscribed to a topic, guarded by the sessions mutex
+    std::unordered_map<std::string, std::unordered_set<int>> mTopics;
+    // sessions invoke the callbacks from their strands, so guard replacing them
+    std::mutex mCallbackMutex;
+    NewSessionCallback mNewSessionCallback;
+    SessionRetiredCallback mSessionRetiredCallback;
+    ListenerStats mStats;
+    PeriodicTimer mStatsTimer;
 
 public:
-    // take ownership shared ptr of our web socket thread so we maintain the lifetime of the thread
+    // take ownership shared ptr of our web socket thread so we maintain the lifetime of the thread.
+    // a host of the form `unix:/path` listens on a unix domain socket at that path instead of the port
     WebSocketListener(
         boost::asio::io_context& context,
         std::string& host,
@@ -90,10 +229,57 @@ public:
 
     void stop();
 
-    NewSessionCallback mNewSessionCallback;
+    void setCompression(const beast::websocket::permessage_deflate& compression);
+
+    // applies to sessions which get accepted afterwards
+    void setKeepAlive(const KeepAliveOptions& keepAlive);
+
+    // sends the message to all open sessions, sharing the same payload between them.
+    // returns the number of sessions the message was enqueued for
+    size_t broadcast(const WebSocketPayload& message);
+
+    // lets sessions (un)subscribe and publish to topics via text frames of the form
+    // `#sub <topic>`, `#unsub <topic>` and `#pub <topic>\n<message>` - the latter can
+    // also be a binary frame. These frames do not get passed on to sclang.
+    void setTopicControlFrames(bool enabled);
+
+    // relays binary messages of all sessions accepted afterwards, see `UdpRelay`
+    void setUdpRelay(const UdpRelayConfig& config);
+
+    void subscribe(int sessionId, const std::string& topic);
+
+    void unsubscribe(int sessionId, const std::string& topic);
+
+    // sends the message to all sessions subscribed to the topic, sharing the same payload
+    // between them. returns the number of sessions the message was enqueued for
+    size_t publish(const std::string& topic, const WebSocketPayload& message, int excludedSessionId = -1);
+
+    void addSession(const std::shared_ptr<WebSocketSession>& session);
+
+    // gets called by the session once it has been closed or failed to connect
+    void removeSession(WebSocketSession& session);
+
+    // can be called from any thread - a snapshot of the counters of the listener
+    // and all its open sessions as a JSON object
+    std::string getStatsJson();
+
+    // pushes a snapshot of the stats every interval, an interval of 0 stops pushing
+    void setStatsInterval(std::chrono::milliseconds interval, StatsCallback callback);
+
+    // gets called by a session which failed its websocket handshake
+    void recordHandshakeFailure() { mStats.handshakeFailures.fetch_add(1, std::memory_order_relaxed); }
+
+    // callbacks can be replaced from any thread
+    void setNewSessionCallback(NewSessionCallback callback);
+
+    // gets called after a session has been removed, from the strand of the session
+    void setSessionRetiredCallback(SessionRetiredCallback callback);
 
 private:
+    // listens on the unix domain socket at `mLocalPath`
+    void openLocal(beast::error_code& ec);
+
     void doAccept();
 
-    void onAccept(beast::error_code ec, boost::asio::ip::tcp::socket socket);
+    void onAccept(beast::error_code ec, TransportSocket socket);
 };
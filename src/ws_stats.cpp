@@ -0,0 +1,177 @@
+#include "ws_stats.h"
+
+#include <algorithm>
+
+#include <boost/asio/error.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/websocket/error.hpp>
+#include <boost/json.hpp>
+
+namespace {
+
+boost::json::array histogramToJson(const Log2Histogram& histogram) {
+    auto buckets = histogram.snapshot();
+    // trailing empty buckets get omitted
+    size_t numBuckets = buckets.size();
+    while (numBuckets > 0 && buckets[numBuckets - 1] == 0) {
+        numBuckets--;
+    }
+    return boost::json::array(buckets.begin(), buckets.begin() + numBuckets);
+}
+
+boost::json::object rttToJson(const RttWindow& rtt) {
+    auto snapshot = rtt.snapshot();
+    return boost::json::object {
+        { "samples", snapshot.numSamples },
+        { "latest", snapshot.latest },
+        { "min", snapshot.min },
+        { "avg", snapshot.avg },
+        { "p99", snapshot.p99 },
+    };
+}
+
+}
+
+const char* disconnectReasonName(DisconnectReason reason) {
+    switch (reason) {
+    case DisconnectReason::none:
+        return "none";
+    case DisconnectReason::local:
+        return "local";
+    case DisconnectReason::closed:
+        return "closed";
+    case DisconnectReason::eof:
+        return "eof";
+    case DisconnectReason::timeout:
+        return "timeout";
+    case DisconnectReason::slowConsumer:
+        return "slowConsumer";
+    case DisconnectReason::error:
+        return "error";
+    }
+    return "unknown";
+}
+
+DisconnectReason disconnectReasonFromError(const boost::system::error_code& ec) {
+    if (ec == boost::beast::websocket::error::closed) {
+        return DisconnectReason::closed;
+    }
+    if (ec == boost::asio::error::eof) {
+        return DisconnectReason::eof;
+    }
+    if (ec == boost::beast::error::timeout) {
+        return DisconnectReason::timeout;
+    }
+    // pending operations get aborted if the connection gets closed locally
+    if (ec == boost::asio::error::operation_aborted) {
+        return DisconnectReason::local;
+    }
+    return DisconnectReason::error;
+}
+
+void Log2Histogram::record(uint64_t value) {
+    size_t bucket = 0;
+    while (value > 0 && bucket < kNumBuckets - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    mBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::array<uint64_t, Log2Histogram::kNumBuckets> Log2Histogram::snapshot() const {
+    std::array<uint64_t, kNumBuckets> buckets;
+    for (size_t i = 0; i < kNumBuckets; i++) {
+        buckets[i] = mBuckets[i].load(std::memory_order_relaxed);
+    }
+    return buckets;
+}
+
+void RttWindow::record(std::chrono::steady_clock::duration rtt) {
+    auto index = mNumSamples.load(std::memory_order_relaxed);
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(rtt).count();
+    mSamples[index % kNumSamples].store(std::max<int64_t>(0, micros), std::memory_order_relaxed);
+    mNumSamples.store(index + 1, std::memory_order_release);
+}
+
+RttWindow::Snapshot RttWindow::snapshot() const {
+    auto numSamples = mNumSamples.load(std::memory_order_acquire);
+    if (numSamples == 0) {
+        return Snapshot { 0, 0, 0, 0, 0 };
+    }
+    std::array<uint64_t, kNumSamples> samples;
+    auto size = std::min<uint64_t>(numSamples, kNumSamples);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; i++) {
+        samples[i] = mSamples[i].load(std::memory_order_relaxed);
+        sum += samples[i];
+    }
+    auto latest = mSamples[(numSamples - 1) % kNumSamples].load(std::memory_order_relaxed);
+    std::sort(samples.begin(), samples.begin() + size);
+    return Snapshot {
+        .numSamples = numSamples,
+        .latest = latest,
+        .min = samples[0],
+        .avg = sum / size,
+        .p99 = samples[std::min<uint64_t>(size - 1, size * 99 / 100)],
+    };
+}
+
+void ConnectionStats::recordRead(size_t numBytes) {
+    messagesRead.fetch_add(1, std::memory_order_relaxed);
+    bytesRead.fetch_add(numBytes, std::memory_order_relaxed);
+    readSizes.record(numBytes);
+}
+
+void ConnectionStats::recordWrite(size_t numBytes, std::chrono::steady_clock::duration latency) {
+    messagesWritten.fetch_add(1, std::memory_order_relaxed);
+    bytesWritten.fetch_add(numBytes, std::memory_order_relaxed);
+    writeLatencies.record(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+}
+
+bool ConnectionStats::setDisconnectReason(DisconnectReason reason) {
+    auto expected = static_cast<int>(DisconnectReason::none);
+    return disconnectReason.compare_exchange_strong(expected, static_cast<int>(reason), std::memory_order_relaxed);
+}
+
+std::string connectionStatsToJson(const ConnectionStats& stats, const QueueStats& queue, const WireStats& wire) {
+    boost::json::object object {
+        { "messagesRead", stats.messagesRead.load(std::memory_order_relaxed) },
+        { "messagesWritten", stats.messagesWritten.load(std::memory_order_relaxed) },
+        { "bytesRead", stats.bytesRead.load(std::memory_order_relaxed) },
+        { "bytesWritten", stats.bytesWritten.load(std::memory_order_relaxed) },
+        { "wireBytesRead", wire.bytesRead },
+        { "wireBytesWritten", wire.bytesWritten },
+        { "queuedMessages", queue.numMessages },
+        { "queuedBytes", queue.numBytes },
+        { "peakQueuedMessages", queue.peakNumMessages },
+        { "droppedMessages", queue.numDropped },
+        { "connectFailures", stats.connectFailures.load(std::memory_order_relaxed) },
+        { "disconnectReason", disconnectReasonName(stats.getDisconnectReason()) },
+        { "readSizes", histogramToJson(stats.readSizes) },
+        { "writeLatencies", histogramToJson(stats.writeLatencies) },
+        { "rtt", rttToJson(stats.rtt) },
+    };
+    return boost::json::serialize(object);
+}
+
+std::string listenerStatsToJson(const ListenerStats& stats, size_t numOpenSessions, const std::string& sessions) {
+    boost::json::object disconnects;
+    for (size_t i = 1; i < kNumDisconnectReasons; i++) {
+        disconnects[disconnectReasonName(static_cast<DisconnectReason>(i))] =
+            stats.disconnects[i].load(std::memory_order_relaxed);
+    }
+    boost::json::object object {
+        { "accepted", stats.accepted.load(std::memory_order_relaxed) },
+        { "acceptFailures", stats.acceptFailures.load(std::memory_order_relaxed) },
+        { "handshakeFailures", stats.handshakeFailures.load(std::memory_order_relaxed) },
+        { "openSessions", numOpenSessions },
+        { "disconnects", std::move(disconnects) },
+    };
+    // the sessions are already serialized, so append them instead of parsing them again
+    auto json = boost::json::serialize(object);
+    json.pop_back();
+    json += ",\"sessions\":";
+    json += sessions;
+    json += '}';
+    return json;
+}
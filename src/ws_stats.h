@@ -0,0 +1,136 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include <boost/system/error_code.hpp>
+
+// why a connection got closed, the first reason which occurs sticks
+enum class DisconnectReason : int {
+    none = 0,
+    // closed via sclang
+    local = 1,
+    // the peer sent a close frame
+    closed = 2,
+    // the peer closed the socket without a close frame
+    eof = 3,
+    timeout = 4,
+    // the send queue did not drain in time, see `QueuePolicy::disconnect`
+    slowConsumer = 5,
+    error = 6,
+};
+
+constexpr size_t kNumDisconnectReasons = 7;
+
+const char* disconnectReasonName(DisconnectReason reason);
+
+// classifies the error of a failed read
+DisconnectReason disconnectReasonFromError(const boost::system::error_code& ec);
+
+/** Counts values in power of two buckets, so bucket i holds the values below 2^i
+which did not fit into bucket i - 1. Can be written and read from any thread.
+*/
+class Log2Histogram {
+public:
+    static constexpr size_t kNumBuckets = 32;
+
+    void record(uint64_t value);
+
+    std::array<uint64_t, kNumBuckets> snapshot() const;
+
+private:
+    std::array<std::atomic<uint64_t>, kNumBuckets> mBuckets {};
+};
+
+/** The round trip times of the latest pings of a connection.
+Gets written from the strand of the connection and can be read from any thread.
+*/
+class RttWindow {
+public:
+    static constexpr size_t kNumSamples = 128;
+
+    // all in microseconds, 0 if no pong has been received yet
+    struct Snapshot {
+        uint64_t numSamples;
+        uint64_t latest;
+        uint64_t min;
+        uint64_t avg;
+        uint64_t p99;
+    };
+
+    void record(std::chrono::steady_clock::duration rtt);
+
+    // computed over the samples within the window
+    Snapshot snapshot() const;
+
+private:
+    std::array<std::atomic<uint64_t>, kNumSamples> mSamples {};
+    std::atomic<uint64_t> mNumSamples = 0;
+};
+
+/** Counters of a session or client.
+They get written from the strand of the connection and can be read from any thread,
+so a snapshot is not necessarily consistent between the counters.
+*/
+struct ConnectionStats {
+    std::atomic<uint64_t> messagesRead = 0;
+    std::atomic<uint64_t> messagesWritten = 0;
+    // message bytes before framing and compression
+    std::atomic<uint64_t> bytesRead = 0;
+    std::atomic<uint64_t> bytesWritten = 0;
+    // failed resolves, connects and handshakes of a client
+    std::atomic<uint64_t> connectFailures = 0;
+    std::atomic<int> disconnectReason = static_cast<int>(DisconnectReason::none);
+    Log2Histogram readSizes;
+    // microseconds from starting a write until it has completed
+    Log2Histogram writeLatencies;
+    RttWindow rtt;
+
+    void recordRead(size_t numBytes);
+
+    void recordWrite(size_t numBytes, std::chrono::steady_clock::duration latency);
+
+    // returns false if a reason has already been set
+    bool setDisconnectReason(DisconnectReason reason);
+
+    DisconnectReason getDisconnectReason() const {
+        return static_cast<DisconnectReason>(disconnectReason.load(std::memory_order_relaxed));
+    }
+};
+
+// the current state of the send queue of a connection
+struct QueueStats {
+    size_t numMessages;
+    size_t numBytes;
+    size_t peakNumMessages;
+    size_t numDropped;
+};
+
+// counters of a listener which can be read from any thread
+struct ListenerStats {
+    std::atomic<uint64_t> accepted = 0;
+    std::atomic<uint64_t> acceptFailures = 0;
+    // connections which got accepted on the socket but failed the websocket handshake
+    std::atomic<uint64_t> handshakeFailures = 0;
+    std::array<std::atomic<uint64_t>, kNumDisconnectReasons> disconnects {};
+};
+
+// the byte counters on the wire, see `StreamByteCounters`
+struct WireStats {
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+};
+
+// receives a snapshot of stats as JSON
+using StatsCallback = std::function<void(const std::string& json)>;
+
+// serializes the counters of a connection as a JSON object
+std::string connectionStatsToJson(const ConnectionStats& stats, const QueueStats& queue, const WireStats& wire);
+
+// serializes the counters of a listener as a JSON object, `sessions` has to be a JSON object
+// of the stats of the open sessions
+std::string listenerStatsToJson(const ListenerStats& stats, size_t numOpenSessions, const std::string& sessions);
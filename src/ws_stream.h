@@ -0,0 +1,240 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <variant>
+
+#include <boost/asio/associator.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/websocket/teardown.hpp>
+
+// bytes which got transferred through a stream - read from any thread
+struct StreamByteCounters {
+    std::atomic<uint64_t> bytesRead = 0;
+    std::atomic<uint64_t> bytesWritten = 0;
+};
+
+// message bytes are counted before and wire bytes after framing and compression
+struct CompressionStats {
+    uint64_t messageBytesRead;
+    uint64_t messageBytesWritten;
+    uint64_t wireBytesRead;
+    uint64_t wireBytesWritten;
+};
+
+// completion handler which adds the transferred bytes to a counter before
+// invoking the wrapped handler, see `CountingStream`
+template <class Handler>
+class CountingHandler {
+public:
+    template <class DeducedHandler>
+    CountingHandler(DeducedHandler&& handler, std::atomic<uint64_t>& counter):
+        mHandler(std::forward<DeducedHandler>(handler)),
+        mCounter(&counter)
+    {}
+
+    void operator()(boost::beast::error_code ec, std::size_t bytesTransferred) {
+        mCounter->fetch_add(bytesTransferred, std::memory_order_relaxed);
+        mHandler(ec, bytesTransferred);
+    }
+
+    Handler mHandler;
+
+private:
+    std::atomic<uint64_t>* mCounter;
+};
+
+/** A stream layer between the websocket and its socket which counts the bytes on the wire.
+As these bytes are after framing and compression, comparing them with the size
+of the messages yields the compression ratio of a connection.
+*/
+template <class NextLayer>
+class CountingStream {
+public:
+    using executor_type = typename NextLayer::executor_type;
+
+    template <class... Args>
+    explicit CountingStream(Args&&... args): mNextLayer(std::forward<Args>(args)...) {}
+
+    executor_type get_executor() noexcept { return mNextLayer.get_executor(); }
+
+    NextLayer& next_layer() noexcept { return mNextLayer; }
+
+    const NextLayer& next_layer() const noexcept { return mNextLayer; }
+
+    const StreamByteCounters& counters() const { return mCounters; }
+
+    template <class MutableBufferSequence, class ReadHandler>
+    auto async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler) {
+        return mNextLayer.async_read_some(
+            buffers,
+            CountingHandler<std::decay_t<ReadHandler>>(std::forward<ReadHandler>(handler), mCounters.bytesRead));
+    }
+
+    template <class ConstBufferSequence, class WriteHandler>
+    auto async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+        return mNextLayer.async_write_some(
+            buffers,
+            CountingHandler<std::decay_t<WriteHandler>>(std::forward<WriteHandler>(handler), mCounters.bytesWritten));
+    }
+
+private:
+    NextLayer mNextLayer;
+    StreamByteCounters mCounters;
+};
+
+// the websocket closing handshake gets forwarded to the wrapped socket
+
+template <class NextLayer>
+void teardown(boost::beast::role_type role, CountingStream<NextLayer>& stream, boost::beast::error_code& ec) {
+    using boost::beast::websocket::teardown;
+    teardown(role, stream.next_layer(), ec);
+}
+
+template <class NextLayer, class TeardownHandler>
+void async_teardown(boost::beast::role_type role, CountingStream<NextLayer>& stream, TeardownHandler&& handler) {
+    using boost::beast::websocket::async_teardown;
+    async_teardown(role, stream.next_layer(), std::forward<TeardownHandler>(handler));
+}
+
+/** The socket below the websocket of a connection, either a TCP socket or a unix domain socket.
+Peers on the same host can connect via a unix domain socket, which skips the TCP stack.
+Holding either socket keeps a single session and client type, instead of turning them and
+everything which refers to them into templates - the socket gets selected once per operation.
+Unix domain sockets are only available on platforms which asio supports them on.
+*/
+class TransportSocket {
+public:
+    using executor_type = boost::asio::any_io_executor;
+    using TcpSocket = boost::asio::ip::tcp::socket;
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    using LocalSocket = boost::asio::local::stream_protocol::socket;
+#endif
+
+    explicit TransportSocket(TcpSocket&& socket): mSocket(std::move(socket)) {}
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    explicit TransportSocket(LocalSocket&& socket): mSocket(std::move(socket)) {}
+
+    // creates an unconnected socket
+    TransportSocket(const executor_type& executor, bool isLocal):
+        mSocket(isLocal ? Socket(std::in_place_type<LocalSocket>, executor)
+                        : Socket(std::in_place_type<TcpSocket>, executor))
+    {}
+#else
+    TransportSocket(const executor_type& executor, bool): mSocket(std::in_place_type<TcpSocket>, executor) {}
+#endif
+
+    executor_type get_executor() noexcept {
+        return std::visit([](auto& socket) -> executor_type { return socket.get_executor(); }, mSocket);
+    }
+
+    bool isLocal() const { return !std::holds_alternative<TcpSocket>(mSocket); }
+
+    TcpSocket& tcpSocket() { return std::get<TcpSocket>(mSocket); }
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    LocalSocket& localSocket() { return std::get<LocalSocket>(mSocket); }
+#endif
+
+    // small frames like pongs must not wait for the ack of the previous frame.
+    // unix domain sockets do not delay writes, so this only applies to TCP
+    void setNoDelay() {
+        if (auto socket = std::get_if<TcpSocket>(&mSocket)) {
+            boost::beast::error_code ec;
+            socket->set_option(boost::asio::ip::tcp::no_delay(true), ec);
+        }
+    }
+
+    void cancel() {
+        std::visit([](auto& socket) {
+            boost::beast::error_code ec;
+            socket.cancel(ec);
+        }, mSocket);
+    }
+
+    void close() {
+        std::visit([](auto& socket) {
+            boost::beast::error_code ec;
+            socket.close(ec);
+        }, mSocket);
+    }
+
+    template <class MutableBufferSequence, class ReadHandler>
+    void async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler) {
+        std::visit([&](auto& socket) { socket.async_read_some(buffers, std::forward<ReadHandler>(handler)); }, mSocket);
+    }
+
+    template <class ConstBufferSequence, class WriteHandler>
+    void async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+        std::visit([&](auto& socket) { socket.async_write_some(buffers, std::forward<WriteHandler>(handler)); }, mSocket);
+    }
+
+    template <class Function>
+    friend auto visitSocket(TransportSocket& socket, Function&& function) {
+        return std::visit(std::forward<Function>(function), socket.mSocket);
+    }
+
+private:
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    using Socket = std::variant<TcpSocket, LocalSocket>;
+#else
+    using Socket = std::variant<TcpSocket>;
+#endif
+
+    Socket mSocket;
+};
+
+// hosts of the form `unix:/path/to/socket` refer to a unix domain socket.
+// returns the path of the socket, or an empty string for a network host
+inline std::string localSocketPath(const std::string& host) {
+    constexpr std::string_view prefix = "unix:";
+    if (host.compare(0, prefix.size(), prefix) != 0) {
+        return {};
+    }
+    return host.substr(prefix.size());
+}
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+// the endpoint of a unix domain socket throws for a path which does not fit into `sockaddr_un`
+inline bool isLocalSocketPathTooLong(const std::string& path) {
+    return path.size() >= sizeof(boost::asio::detail::sockaddr_un_type::sun_path);
+}
+#endif
+
+// lets beast close the socket, e.g. after a failed closing handshake
+inline void beast_close_socket(TransportSocket& socket) { socket.close(); }
+
+inline void teardown(boost::beast::role_type role, TransportSocket& socket, boost::beast::error_code& ec) {
+    visitSocket(socket, [&](auto& next) {
+        using boost::beast::websocket::teardown;
+        teardown(role, next, ec);
+    });
+}
+
+template <class TeardownHandler>
+void async_teardown(boost::beast::role_type role, TransportSocket& socket, TeardownHandler&& handler) {
+    visitSocket(socket, [&](auto& next) {
+        using boost::beast::websocket::async_teardown;
+        async_teardown(role, next, std::forward<TeardownHandler>(handler));
+    });
+}
+
+// forward the associated executor, allocator and cancellation slot of the wrapped handler,
+// otherwise the handler would lose e.g. its strand
+namespace boost::asio {
+template <template <typename, typename> class Associator, typename Handler, typename DefaultCandidate>
+struct associator<Associator, CountingHandler<Handler>, DefaultCandidate> : Associator<Handler, DefaultCandidate> {
+    static typename Associator<Handler, DefaultCandidate>::type get(const CountingHandler<Handler>& h) noexcept {
+        return Associator<Handler, DefaultCandidate>::get(h.mHandler);
+    }
+
+    static auto get(const CountingHandler<Handler>& h, const DefaultCandidate& c) noexcept
+        -> decltype(Associator<Handler, DefaultCandidate>::get(h.mHandler, c)) {
+        return Associator<Handler, DefaultCandidate>::get(h.mHandler, c);
+    }
+};
+}
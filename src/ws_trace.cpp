@@ -0,0 +1,295 @@
+#include "ws_trace.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+constexpr size_t kRingSize = 2048;
+
+// the fields are atomics, so a reader can copy a slot while its thread overwrites it.
+// a slot has been written completely if its sequence is even and matches its index
+struct TraceSlot {
+    std::atomic<uint64_t> sequence = 0;
+    std::atomic<uint64_t> timestamp = 0;
+    std::atomic<uint64_t> size = 0;
+    std::atomic<int32_t> id = 0;
+    std::atomic<uint16_t> event = 0;
+    std::atomic<int> errorValue = 0;
+    std::atomic<const boost::system::error_category*> errorCategory = nullptr;
+};
+
+struct TraceRing {
+    // rings of threads which have exited get reused by new threads
+    std::atomic<bool> inUse = true;
+    uint32_t threadIndex = 0;
+    // only written by the thread which uses the ring
+    std::atomic<uint64_t> writeIndex = 0;
+    // only accessed by `traceDrain`
+    uint64_t drainIndex = 0;
+    std::array<TraceSlot, kRingSize> slots;
+};
+
+struct TraceEntry {
+    uint64_t timestamp;
+    uint32_t threadIndex;
+    int32_t id;
+    TraceEvent event;
+    uint64_t size;
+    int errorValue;
+    const boost::system::error_category* errorCategory;
+};
+
+const auto gEpoch = std::chrono::steady_clock::now();
+
+// leaked on purpose, as threads may still trace while static objects get destroyed
+std::mutex* gRingsMutex = new std::mutex();
+auto* gRings = new std::vector<std::unique_ptr<TraceRing>>();
+uint32_t gNumThreads = 0;
+
+// returns the ring of a thread on exit
+struct RingLease {
+    TraceRing* ring = nullptr;
+
+    ~RingLease() {
+        if (ring) {
+            ring->inUse.store(false, std::memory_order_release);
+        }
+    }
+};
+
+thread_local RingLease gRingLease;
+
+TraceRing* acquireRing() {
+    std::lock_guard<std::mutex> lock(*gRingsMutex);
+    TraceRing* ring = nullptr;
+    for (auto& candidate : *gRings) {
+        if (!candidate->inUse.load(std::memory_order_acquire)) {
+            ring = candidate.get();
+            ring->inUse.store(true, std::memory_order_relaxed);
+            break;
+        }
+    }
+    if (ring == nullptr) {
+        ring = gRings->emplace_back(std::make_unique<TraceRing>()).get();
+    }
+    ring->threadIndex = gNumThreads++;
+    return ring;
+}
+
+// copies the completely written entries from `from` on, returns the write index it read up to
+uint64_t collect(TraceRing& ring, uint64_t from, std::vector<TraceEntry>& entries) {
+    auto to = ring.writeIndex.load(std::memory_order_acquire);
+    for (auto index = std::max(from, to > kRingSize ? to - kRingSize : 0); index < to; index++) {
+        auto& slot = ring.slots[index % kRingSize];
+        auto sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != 2 * index + 2) {
+            // got overwritten in the meantime
+            continue;
+        }
+        TraceEntry entry {
+            .timestamp = slot.timestamp.load(std::memory_order_relaxed),
+            .threadIndex = ring.threadIndex,
+            .id = slot.id.load(std::memory_order_relaxed),
+            .event = static_cast<TraceEvent>(slot.event.load(std::memory_order_relaxed)),
+            .size = slot.size.load(std::memory_order_relaxed),
+            .errorValue = slot.errorValue.load(std::memory_order_relaxed),
+            .errorCategory = slot.errorCategory.load(std::memory_order_relaxed),
+        };
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == sequence) {
+            entries.push_back(entry);
+        }
+    }
+    return to;
+}
+
+std::string format(std::vector<TraceEntry>& entries) {
+    std::sort(entries.begin(), entries.end(), [](const TraceEntry& a, const TraceEntry& b) {
+        return a.timestamp < b.timestamp;
+    });
+    std::string text;
+    char line[160];
+    for (const auto& entry : entries) {
+        auto length = std::snprintf(
+            line,
+            sizeof(line),
+            "%.6f t%u %s id=%d",
+            static_cast<double>(entry.timestamp) / 1e9,
+            entry.threadIndex,
+            traceEventName(entry.event),
+            entry.id
+        );
+        text.append(line, std::min<size_t>(length, sizeof(line) - 1));
+        if (entry.size > 0) {
+            text += " size=" + std::to_string(entry.size);
+        }
+        if (entry.errorCategory != nullptr) {
+            text += " error=" + entry.errorCategory->message(entry.errorValue);
+        }
+        text += '\n';
+    }
+    return text;
+}
+
+}
+
+namespace detail {
+std::atomic<int> gTraceLevel = static_cast<int>(TraceLevel::error);
+
+void traceRecord(TraceEvent event, int32_t id, uint64_t size, const boost::system::error_code& ec) {
+    auto ring = gRingLease.ring;
+    if (ring == nullptr) {
+        ring = gRingLease.ring = acquireRing();
+    }
+    auto index = ring->writeIndex.load(std::memory_order_relaxed);
+    auto& slot = ring->slots[index % kRingSize];
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    auto timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - gEpoch);
+    slot.timestamp.store(timestamp.count(), std::memory_order_relaxed);
+    slot.size.store(size, std::memory_order_relaxed);
+    slot.id.store(id, std::memory_order_relaxed);
+    slot.event.store(static_cast<uint16_t>(event), std::memory_order_relaxed);
+    slot.errorValue.store(ec.value(), std::memory_order_relaxed);
+    slot.errorCategory.store(ec ? &ec.category() : nullptr, std::memory_order_relaxed);
+    slot.sequence.store(2 * index + 2, std::memory_order_release);
+    ring->writeIndex.store(index + 1, std::memory_order_release);
+}
+}
+
+TraceLevel traceEventLevel(TraceEvent event) {
+    switch (event) {
+    case TraceEvent::sessionRead:
+    case TraceEvent::sessionWrite:
+    case TraceEvent::clientRead:
+    case TraceEvent::clientWrite:
+        return TraceLevel::debug;
+    case TraceEvent::ioThreadStarted:
+    case TraceEvent::ioThreadStopped:
+    case TraceEvent::libraryUnloaded:
+    case TraceEvent::listenerStarted:
+    case TraceEvent::accepted:
+    case TraceEvent::sessionStarted:
+    case TraceEvent::sessionAccepted:
+    case TraceEvent::sessionClosed:
+    case TraceEvent::clientConnected:
+    case TraceEvent::clientClosed:
+    case TraceEvent::clientReconnectScheduled:
+        return TraceLevel::info;
+    default:
+        return TraceLevel::error;
+    }
+}
+
+const char* traceEventName(TraceEvent event) {
+    switch (event) {
+    case TraceEvent::ioThreadStarted:
+        return "ioThreadStarted";
+    case TraceEvent::ioThreadStopped:
+        return "ioThreadStopped";
+    case TraceEvent::libraryUnloaded:
+        return "libraryUnloaded";
+    case TraceEvent::tooManySessions:
+        return "tooManySessions";
+    case TraceEvent::listenerOpenFailed:
+        return "listenerOpenFailed";
+    case TraceEvent::listenerStarted:
+        return "listenerStarted";
+    case TraceEvent::listenerCloseFailed:
+        return "listenerCloseFailed";
+    case TraceEvent::accepted:
+        return "accepted";
+    case TraceEvent::acceptFailed:
+        return "acceptFailed";
+    case TraceEvent::sessionStarted:
+        return "sessionStarted";
+    case TraceEvent::sessionAccepted:
+        return "sessionAccepted";
+    case TraceEvent::sessionHandshakeFailed:
+        return "sessionHandshakeFailed";
+    case TraceEvent::sessionClosed:
+        return "sessionClosed";
+    case TraceEvent::sessionReadFailed:
+        return "sessionReadFailed";
+    case TraceEvent::sessionCloseFailed:
+        return "sessionCloseFailed";
+    case TraceEvent::sessionRead:
+        return "sessionRead";
+    case TraceEvent::sessionWrite:
+        return "sessionWrite";
+    case TraceEvent::sessionWriteFailed:
+        return "sessionWriteFailed";
+    case TraceEvent::clientMissingCallbacks:
+        return "clientMissingCallbacks";
+    case TraceEvent::clientResolveFailed:
+        return "clientResolveFailed";
+    case TraceEvent::clientConnectFailed:
+        return "clientConnectFailed";
+    case TraceEvent::clientHandshakeFailed:
+        return "clientHandshakeFailed";
+    case TraceEvent::clientConnected:
+        return "clientConnected";
+    case TraceEvent::clientClosed:
+        return "clientClosed";
+    case TraceEvent::clientReadFailed:
+        return "clientReadFailed";
+    case TraceEvent::clientCloseFailed:
+        return "clientCloseFailed";
+    case TraceEvent::clientNotConnected:
+        return "clientNotConnected";
+    case TraceEvent::clientRead:
+        return "clientRead";
+    case TraceEvent::clientWrite:
+        return "clientWrite";
+    case TraceEvent::clientWriteFailed:
+        return "clientWriteFailed";
+    case TraceEvent::clientReconnectScheduled:
+        return "clientReconnectScheduled";
+    case TraceEvent::relayStartFailed:
+        return "relayStartFailed";
+    case TraceEvent::relaySendFailed:
+        return "relaySendFailed";
+    case TraceEvent::relayReceiveFailed:
+        return "relayReceiveFailed";
+    }
+    return "unknown";
+}
+
+void setTraceLevel(TraceLevel level) { detail::gTraceLevel.store(static_cast<int>(level), std::memory_order_relaxed); }
+
+std::string traceDump() {
+    std::vector<TraceEntry> entries;
+    {
+        std::lock_guard<std::mutex> lock(*gRingsMutex);
+        for (auto& ring : *gRings) {
+            collect(*ring, 0, entries);
+        }
+    }
+    return format(entries);
+}
+
+std::string traceDrain() {
+    std::vector<TraceEntry> entries;
+    uint64_t numDropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(*gRingsMutex);
+        for (auto& ring : *gRings) {
+            auto writeIndex = ring->writeIndex.load(std::memory_order_acquire);
+            if (writeIndex - ring->drainIndex > kRingSize) {
+                numDropped += writeIndex - ring->drainIndex - kRingSize;
+            }
+            ring->drainIndex = collect(*ring, ring->drainIndex, entries);
+        }
+    }
+    auto text = format(entries);
+    if (numDropped > 0) {
+        text += std::to_string(numDropped) + " events got overwritten before they could be drained\n";
+    }
+    return text;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <boost/system/error_code.hpp>
+
+/** Tracing of what the library is doing, without blocking the io threads.
+Every thread writes binary events into its own fixed-size ring buffer, so tracing
+an event costs a few nanoseconds and never locks or touches the console. Once a
+ring is full the oldest events get overwritten. The events get formatted
+as text only when they get dumped, see `traceDump` and `traceDrain`.
+*/
+
+enum class TraceLevel : int {
+    off = 0,
+    error = 1,
+    info = 2,
+    // also traces every read and write
+    debug = 3,
+};
+
+enum class TraceEvent : uint16_t {
+    // library
+    ioThreadStarted,
+    ioThreadStopped,
+    libraryUnloaded,
+    tooManySessions,
+    // listener, the id is its port
+    listenerOpenFailed,
+    listenerStarted,
+    listenerCloseFailed,
+    accepted,
+    acceptFailed,
+    // session, the id is its session id
+    sessionStarted,
+    sessionAccepted,
+    sessionHandshakeFailed,
+    sessionClosed,
+    sessionReadFailed,
+    sessionCloseFailed,
+    sessionRead,
+    sessionWrite,
+    sessionWriteFailed,
+    // client, the id is its handle
+    clientMissingCallbacks,
+    clientResolveFailed,
+    clientConnectFailed,
+    clientHandshakeFailed,
+    clientConnected,
+    clientClosed,
+    clientReadFailed,
+    clientCloseFailed,
+    clientNotConnected,
+    clientRead,
+    clientWrite,
+    clientWriteFailed,
+    // the size is the delay in ms
+    clientReconnectScheduled,
+    // udp relay, the id is the session id for starting and the port of its target otherwise
+    relayStartFailed,
+    relaySendFailed,
+    relayReceiveFailed,
+};
+
+// the level at which an event gets traced
+TraceLevel traceEventLevel(TraceEvent event);
+
+const char* traceEventName(TraceEvent event);
+
+namespace detail {
+extern std::atomic<int> gTraceLevel;
+
+void traceRecord(TraceEvent event, int32_t id, uint64_t size, const boost::system::error_code& ec);
+}
+
+// can be changed at runtime from any thread, events above the level do not get traced
+void setTraceLevel(TraceLevel level);
+
+inline bool isTraced(TraceEvent event) {
+    return static_cast<int>(traceEventLevel(event)) <= detail::gTraceLevel.load(std::memory_order_relaxed);
+}
+
+// traces an event of a listener, session or client - size is e.g. the number of bytes of a read
+inline void trace(TraceEvent event, int32_t id, uint64_t size = 0, const boost::system::error_code& ec = {}) {
+    if (isTraced(event)) {
+        detail::traceRecord(event, id, size, ec);
+    }
+}
+
+inline void trace(TraceEvent event, int32_t id, const boost::system::error_code& ec) { trace(event, id, 0, ec); }
+
+// formats all events which are still in the rings as lines of text, ordered by time
+std::string traceDump();
+
+// formats the events which have been traced since the last drain - only call this from one thread at a time
+std::string traceDrain();